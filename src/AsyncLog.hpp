@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/basic_endpoint.hpp>
+#include "SpscRing.hpp"
+
+// Asynchronous logger for the servers.
+//
+// A log call stores a fixed-size binary record in the calling thread's own SPSC ring:
+// a timestamp, a pointer to the format string literal, and the raw argument values.
+// It never formats, allocates, locks or makes a syscall. A background thread drains
+// every ring, formats the records in timestamp order, and writes them out. When a
+// ring is full the record is dropped and counted; the logger never makes a broadcast
+// wait for stdout.
+//
+// Format strings use "{}" placeholders: LOG_INFO("Client connected: {}", endpoint).
+// Levels below BROADCAST_LOG_LEVEL compile to nothing, so their arguments are not even
+// evaluated (see the CMake option of the same name).
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef BROADCAST_LOG_LEVEL
+#define BROADCAST_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define ASYNC_LOG_AT(level_value, level, ...)                         \
+    do                                                                \
+    {                                                                 \
+        if constexpr ((level_value) >= BROADCAST_LOG_LEVEL)           \
+        {                                                             \
+            async_log::write(async_log::Level::level, __VA_ARGS__);   \
+        }                                                             \
+    } while (0)
+
+#define LOG_DEBUG(...) ASYNC_LOG_AT(LOG_LEVEL_DEBUG, Debug, __VA_ARGS__)
+#define LOG_INFO(...) ASYNC_LOG_AT(LOG_LEVEL_INFO, Info, __VA_ARGS__)
+#define LOG_WARN(...) ASYNC_LOG_AT(LOG_LEVEL_WARN, Warn, __VA_ARGS__)
+#define LOG_ERROR(...) ASYNC_LOG_AT(LOG_LEVEL_ERROR, Error, __VA_ARGS__)
+
+namespace async_log
+{
+    enum class Level : uint8_t { Debug, Info, Warn, Error };
+
+    // Records are copied by value through the ring, so keep them to two cache lines.
+    // Arguments that do not fit are cut off and the line ends in "...".
+    constexpr size_t record_size = 128;
+    // Per logging thread; rings of exited threads are reused by new ones
+    constexpr size_t ring_capacity = 256;
+
+    namespace detail
+    {
+        enum class Tag : uint8_t { Int, UInt, Double, Bool, String, Endpoint4, Endpoint6 };
+
+        struct Record
+        {
+            int64_t timestamp_ns; // system_clock
+            const char* format;   // string literal, lives for the whole program
+            Level level;
+            uint8_t size;         // payload bytes used
+            bool truncated;
+            char payload[record_size - 19];
+        };
+        static_assert(sizeof(Record) == record_size);
+
+        // Appends tagged argument values to a record's payload
+        class Encoder
+        {
+        public:
+            explicit Encoder(Record& record) : record(record) {}
+
+            template <typename T>
+            void put(const T& value)
+            {
+                if constexpr (std::is_same_v<T, bool>)
+                {
+                    raw(Tag::Bool, static_cast<uint8_t>(value));
+                }
+                else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+                {
+                    raw(Tag::Int, static_cast<int64_t>(value));
+                }
+                else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+                {
+                    raw(Tag::UInt, static_cast<uint64_t>(value));
+                }
+                else if constexpr (std::is_floating_point_v<T>)
+                {
+                    raw(Tag::Double, static_cast<double>(value));
+                }
+                else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+                {
+                    string(value);
+                }
+                else
+                {
+                    // Slow path for anything else that can be streamed
+                    std::ostringstream text;
+                    text << value;
+                    string(text.str());
+                }
+            }
+
+            template <typename Protocol>
+            void put(const boost::asio::ip::basic_endpoint<Protocol>& endpoint)
+            {
+                boost::asio::ip::address address = endpoint.address();
+                uint16_t port = endpoint.port();
+                if (address.is_v4())
+                {
+                    auto bytes = address.to_v4().to_bytes();
+                    if (reserve(Tag::Endpoint4, bytes.size() + sizeof(port)))
+                    {
+                        append(bytes.data(), bytes.size());
+                        append(&port, sizeof(port));
+                    }
+                }
+                else
+                {
+                    auto bytes = address.to_v6().to_bytes();
+                    if (reserve(Tag::Endpoint6, bytes.size() + sizeof(port)))
+                    {
+                        append(bytes.data(), bytes.size());
+                        append(&port, sizeof(port));
+                    }
+                }
+            }
+
+            void put(const std::thread::id& id)
+            {
+                raw(Tag::UInt, static_cast<uint64_t>(std::hash<std::thread::id>{}(id)));
+            }
+
+        private:
+            template <typename T>
+            void raw(Tag tag, T value)
+            {
+                if (reserve(tag, sizeof(value)))
+                {
+                    append(&value, sizeof(value));
+                }
+            }
+
+            void string(std::string_view text)
+            {
+                size_t room = sizeof(record.payload) - record.size;
+                if (record.truncated || room < 3)
+                {
+                    record.truncated = true;
+                    return;
+                }
+                size_t length = std::min(text.size(), room - 2);
+                record.truncated = length < text.size();
+                uint8_t header[] = {static_cast<uint8_t>(Tag::String), static_cast<uint8_t>(length)};
+                append(header, sizeof(header));
+                append(text.data(), length);
+            }
+
+            bool reserve(Tag tag, size_t size)
+            {
+                if (record.truncated || record.size + 1 + size > sizeof(record.payload))
+                {
+                    record.truncated = true;
+                    return false;
+                }
+                uint8_t byte = static_cast<uint8_t>(tag);
+                append(&byte, 1);
+                return true;
+            }
+
+            void append(const void* data, size_t size)
+            {
+                std::memcpy(record.payload + record.size, data, size);
+                record.size = static_cast<uint8_t>(record.size + size);
+            }
+
+            Record& record;
+        };
+
+        // Reads the values back on the logger thread
+        class Decoder
+        {
+        public:
+            explicit Decoder(const Record& record) : record(record) {}
+
+            // Writes the next argument, false when there is none left
+            bool next(std::ostream& out)
+            {
+                if (pos >= record.size)
+                {
+                    return false;
+                }
+                Tag tag = static_cast<Tag>(record.payload[pos++]);
+                switch (tag)
+                {
+                case Tag::Int: out << read<int64_t>(); break;
+                case Tag::UInt: out << read<uint64_t>(); break;
+                case Tag::Double: out << read<double>(); break;
+                case Tag::Bool: out << (read<uint8_t>() ? "true" : "false"); break;
+                case Tag::String:
+                {
+                    uint8_t length = read<uint8_t>();
+                    out.write(record.payload + pos, length);
+                    pos += length;
+                    break;
+                }
+                case Tag::Endpoint4:
+                {
+                    auto bytes = read<boost::asio::ip::address_v4::bytes_type>();
+                    out << boost::asio::ip::address_v4(bytes) << ':' << read<uint16_t>();
+                    break;
+                }
+                case Tag::Endpoint6:
+                {
+                    auto bytes = read<boost::asio::ip::address_v6::bytes_type>();
+                    out << '[' << boost::asio::ip::address_v6(bytes) << "]:" << read<uint16_t>();
+                    break;
+                }
+                }
+                return true;
+            }
+
+        private:
+            template <typename T>
+            T read()
+            {
+                T value;
+                std::memcpy(&value, record.payload + pos, sizeof(value));
+                pos += sizeof(value);
+                return value;
+            }
+
+            const Record& record;
+            size_t pos = 0;
+        };
+
+        struct Producer
+        {
+            std::atomic<bool> in_use{true};
+            Producer* next = nullptr;
+            SpscRing<Record> ring{ring_capacity};
+            // Written by the owning thread only
+            std::atomic<uint64_t> dropped{0};
+        };
+
+        // Producers are never freed, so the logger thread can walk the list at any time
+        inline std::atomic<Producer*> producers{nullptr};
+
+        inline void format(std::ostream& out, const Record& record)
+        {
+            static const char* names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+            std::time_t seconds = static_cast<std::time_t>(record.timestamp_ns / 1000000000);
+            std::tm local{};
+#ifdef _WIN32
+            localtime_s(&local, &seconds);
+#else
+            localtime_r(&seconds, &local);
+#endif
+            out << std::put_time(&local, "%H:%M:%S") << '.' << std::setw(6) << std::setfill('0')
+                << (record.timestamp_ns / 1000) % 1000000 << std::setfill(' ') << ' '
+                << names[static_cast<uint8_t>(record.level)] << ' ';
+
+            Decoder args(record);
+            for (const char* c = record.format; *c; ++c)
+            {
+                if (c[0] == '{' && c[1] == '}')
+                {
+                    if (!args.next(out))
+                    {
+                        out << (record.truncated ? "" : "{}");
+                    }
+                    ++c;
+                }
+                else
+                {
+                    out << *c;
+                }
+            }
+            if (record.truncated)
+            {
+                out << "...";
+            }
+            out << '\n';
+        }
+
+        class Logger
+        {
+        public:
+            Logger() : thread([this] { run(); })
+            {
+            }
+
+            // Runs at exit and writes out whatever is still queued
+            ~Logger()
+            {
+                stopping = true;
+                thread.join();
+            }
+
+        private:
+            void run()
+            {
+                std::vector<Record> batch;
+                while (true)
+                {
+                    bool last = stopping.load();
+                    drain(batch);
+                    if (last)
+                    {
+                        return;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }
+
+            void drain(std::vector<Record>& batch)
+            {
+                batch.clear();
+                uint64_t dropped = 0;
+                for (Producer* producer = producers.load(std::memory_order_acquire); producer; producer = producer->next)
+                {
+                    Record record;
+                    while (producer->ring.try_pop(record))
+                    {
+                        batch.push_back(record);
+                    }
+                    dropped += producer->dropped.load(std::memory_order_relaxed);
+                }
+
+                // Each ring is already in order, merge them by time
+                std::stable_sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) { return a.timestamp_ns < b.timestamp_ns; });
+                bool errors = false;
+                for (const Record& record : batch)
+                {
+                    // Warnings and errors keep going to stderr like before
+                    bool to_stderr = record.level >= Level::Warn;
+                    format(to_stderr ? std::cerr : std::cout, record);
+                    errors |= to_stderr;
+                }
+                if (dropped > reported_drops)
+                {
+                    std::cerr << "Logger: " << dropped - reported_drops << " records dropped (ring full)" << std::endl;
+                    reported_drops = dropped;
+                }
+                if (!batch.empty())
+                {
+                    std::cout.flush();
+                    if (errors)
+                    {
+                        std::cerr.flush();
+                    }
+                }
+            }
+
+            std::atomic<bool> stopping{false};
+            uint64_t reported_drops = 0;
+            std::thread thread;
+        };
+
+        inline Logger& logger()
+        {
+            static Logger instance;
+            return instance;
+        }
+
+        inline Producer* claim()
+        {
+            logger(); // the first record starts the logger thread
+            for (Producer* producer = producers.load(std::memory_order_acquire); producer; producer = producer->next)
+            {
+                bool expected = false;
+                if (producer->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    return producer;
+                }
+            }
+            Producer* producer = new Producer;
+            producer->next = producers.load(std::memory_order_relaxed);
+            while (!producers.compare_exchange_weak(producer->next, producer, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            return producer;
+        }
+
+        struct ProducerHandle
+        {
+            Producer* producer = claim();
+
+            ~ProducerHandle()
+            {
+                producer->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        inline Producer& local()
+        {
+            thread_local ProducerHandle handle;
+            return *handle.producer;
+        }
+    }
+
+    // Use the LOG_* macros instead, they compile out below BROADCAST_LOG_LEVEL
+    template <size_t N, typename... Args>
+    void write(Level level, const char (&format)[N], const Args&... args)
+    {
+        detail::Record record;
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record.format = format;
+        record.level = level;
+        record.size = 0;
+        record.truncated = false;
+        detail::Encoder encoder(record);
+        (encoder.put(args), ...);
+
+        detail::Producer& producer = detail::local();
+        if (!producer.ring.try_push(std::move(record)))
+        {
+            producer.dropped.store(producer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,525 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "CommandLine.hpp"
+
+extern char** environ;
+
+// Runs every server against its matching load test over a matrix of client counts,
+// payload sizes and server thread counts, samples the server's CPU and RSS from /proc
+// while the load test runs, and writes one JSON/CSV row per run.
+
+struct Architecture
+{
+    std::string name;
+    std::string server;
+    // "{port}", "{threads}" and "{clients}" are substituted per run
+    std::vector<std::string> server_args;
+    std::string load_test;
+    bool uses_threads;     // run once per --threads value, otherwise once per cell
+    bool supports_payload; // load test understands --payload
+    std::vector<std::string> load_args = {};
+    std::vector<std::string> load_positional = {"localhost", "{port}", "{clients}"};
+};
+
+const std::vector<Architecture> architectures = {
+    {"tcp-async", "TCPSimpleBroadcastAsyncServer", {"{port}", "--threads={threads}"}, "TCPSimpleBroadcastLoadTest", true, true},
+    {"tcp-thread-per-client", "TCPSimpleBroadcastThreadPerClientServer", {"{port}"}, "TCPSimpleBroadcastLoadTest", false, true},
+    {"tcp-reuseport", "TCPSimpleBroadcastSO_REUSEPORTServer", {"{port}", "--threads={threads}"}, "TCPSimpleBroadcastLoadTest", true, true},
+    {"tcp-io-uring", "SimpleBroadcastIoUringServer", {"{port}"}, "TCPSimpleBroadcastLoadTest", false, true},
+    {"udp-async", "UDPSimpleBroadcastAsyncServer", {"{port}"}, "UDPSimpleBroadcastLoadTest", false, true},
+    {"udp-reuseport", "UDPSimpleBroadcastSO_REUSEPORTServer", {"{port}", "--threads={threads}"}, "UDPSimpleBroadcastLoadTest", true, true},
+    {"udp-io-uring", "SimpleBroadcastIoUringServer", {"{port}", "--udp"}, "UDPSimpleBroadcastLoadTest", false, true},
+    {"zeromq", "TCPZeroMQBroadcastServer", {"{port}"}, "TCPZeroMQLoadTest", false, false},
+    {"zeromq-pubsub", "TCPZeroMQBroadcastServer", {"{port}", "--pubsub"}, "TCPZeroMQLoadTest", false, false, {"--pubsub"}},
+    // The load test needs the group and the server port as positional arguments. Runs fail with
+    // "no latency samples" on hosts without a multicast route.
+    {"udp-multicast", "UDPSimpleMulticastServer", {"{port}", "239.255.0.1"}, "UDPSimpleMulticastLoadTest", false, false, {},
+     {"localhost", "{port}", "239.255.0.1", "{clients}"}},
+};
+
+struct Result
+{
+    std::string architecture;
+    int clients = 0;
+    int payload = 0;
+    int threads = 0; // 0 = server has no thread setting
+    int repetition = 0;
+    bool ok = false;
+    std::string failure;
+
+    // Parsed from the load test output, -1 if it did not report them
+    long long errors = -1;
+    long long samples = 0;
+    long long min = -1, max = -1;
+    double avg = -1;
+    long long p50 = -1, p90 = -1, p99 = -1, p999 = -1, p9999 = -1;
+
+    // Server process, sampled while the load test ran
+    double cpu_percent = 0;
+    long peak_rss_kb = 0;
+    double avg_rss_kb = 0;
+    long long duration_ms = 0;
+};
+
+std::vector<std::string> split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+std::vector<int> parse_int_list(const std::string& text)
+{
+    std::vector<int> values;
+    for (auto& part : split(text, ','))
+    {
+        values.push_back(std::stoi(part));
+    }
+    return values;
+}
+
+std::string substitute(std::string text, const std::string& key, const std::string& value)
+{
+    for (size_t pos; (pos = text.find(key)) != std::string::npos;)
+    {
+        text.replace(pos, key.size(), value);
+    }
+    return text;
+}
+
+// Starts 'args' with stdout going to stdout_fd (-1 = inherit) and stderr to stderr_fd
+// (-1 = inherit). Returns the pid, or -1 with errno set.
+pid_t spawn(const std::vector<std::string>& args, int stdout_fd, int stderr_fd)
+{
+    std::vector<char*> argv;
+    for (auto& arg : args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (stdout_fd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    }
+    if (stderr_fd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, stderr_fd, STDERR_FILENO);
+    }
+
+    pid_t pid;
+    int rc = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0)
+    {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+// SIGINT first so servers with a signal_set exit cleanly, SIGKILL if they do not
+void stop(pid_t pid)
+{
+    kill(pid, SIGINT);
+    for (int i = 0; i < 20; ++i)
+    {
+        if (waitpid(pid, nullptr, WNOHANG) == pid)
+        {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// utime + stime of the process in clock ticks, or -1 once it is gone
+long long cpu_ticks(pid_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    if (!std::getline(file, stat))
+    {
+        return -1;
+    }
+    // The command name may contain spaces, so count fields from the closing parenthesis
+    std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+    std::string field;
+    long long utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i)
+    {
+        if (i == 14) utime = std::stoll(field);
+        if (i == 15) stime = std::stoll(field);
+    }
+    return utime + stime;
+}
+
+long rss_kb(pid_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.rfind("VmRSS:", 0) == 0)
+        {
+            return std::stol(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+// Samples a process's CPU time and RSS every 100ms on a background thread
+class ProcessSampler
+{
+public:
+    explicit ProcessSampler(pid_t pid)
+        : pid(pid), start_ticks(cpu_ticks(pid)), start(std::chrono::steady_clock::now())
+    {
+        sampler = std::thread([this]
+        {
+            while (!done)
+            {
+                long rss = rss_kb(this->pid);
+                if (rss > 0)
+                {
+                    peak_rss = std::max(peak_rss, rss);
+                    rss_sum += rss;
+                    rss_samples++;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        });
+    }
+
+    void finish(Result& result)
+    {
+        long long end_ticks = cpu_ticks(pid);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done = true;
+        sampler.join();
+
+        if (start_ticks >= 0 && end_ticks >= 0 && seconds > 0)
+        {
+            result.cpu_percent = 100.0 * static_cast<double>(end_ticks - start_ticks) / sysconf(_SC_CLK_TCK) / seconds;
+        }
+        result.peak_rss_kb = peak_rss;
+        result.avg_rss_kb = rss_samples ? static_cast<double>(rss_sum) / rss_samples : 0;
+    }
+
+private:
+    pid_t pid;
+    long long start_ticks;
+    std::chrono::steady_clock::time_point start;
+    std::thread sampler;
+    std::atomic<bool> done{false};
+    long peak_rss = 0;
+    long long rss_sum = 0;
+    long rss_samples = 0;
+};
+
+// Picks the summary lines printed by every load test out of its stdout
+void parse_load_test_output(const std::string& output, Result& result)
+{
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        long long errors;
+        if (std::sscanf(line.c_str(), "Errors: %lld", &errors) == 1)
+        {
+            result.errors = errors;
+        }
+        std::sscanf(line.c_str(), "Latency (us) -> Min: %lld, Max: %lld, Avg: %lf", &result.min, &result.max, &result.avg);
+        std::sscanf(line.c_str(), "Percentiles (us) -> p50: %lld, p90: %lld, p99: %lld, p99.9: %lld, p99.99: %lld (%lld samples)",
+                    &result.p50, &result.p90, &result.p99, &result.p999, &result.p9999, &result.samples);
+    }
+}
+
+Result run_cell(const Architecture& arch, const std::string& bin_dir, int port, int clients, int payload, int threads,
+                int repetition, const std::vector<std::string>& extra_server_args, const std::vector<std::string>& extra_load_args,
+                std::chrono::milliseconds warmup)
+{
+    Result result;
+    result.architecture = arch.name;
+    result.clients = clients;
+    result.payload = payload;
+    result.threads = threads;
+    result.repetition = repetition;
+
+    auto expand = [&](const std::string& arg)
+    {
+        return substitute(substitute(substitute(arg, "{port}", std::to_string(port)), "{threads}", std::to_string(threads)),
+                          "{clients}", std::to_string(clients));
+    };
+
+    std::vector<std::string> server_cmd = {bin_dir + "/" + arch.server};
+    for (auto& arg : arch.server_args)
+    {
+        server_cmd.push_back(expand(arg));
+    }
+    server_cmd.insert(server_cmd.end(), extra_server_args.begin(), extra_server_args.end());
+
+    std::vector<std::string> load_cmd = {bin_dir + "/" + arch.load_test};
+    for (auto& arg : arch.load_positional)
+    {
+        load_cmd.push_back(expand(arg));
+    }
+    if (arch.supports_payload && payload > 0)
+    {
+        load_cmd.push_back("--payload=" + std::to_string(payload));
+    }
+    load_cmd.insert(load_cmd.end(), arch.load_args.begin(), arch.load_args.end());
+    load_cmd.insert(load_cmd.end(), extra_load_args.begin(), extra_load_args.end());
+
+    // Servers log every broadcast; that output is not part of the measurement
+    int devnull = open("/dev/null", O_WRONLY);
+    pid_t server = spawn(server_cmd, devnull, devnull);
+    close(devnull);
+    if (server < 0)
+    {
+        result.failure = "cannot start " + server_cmd[0] + ": " + std::strerror(errno);
+        return result;
+    }
+
+    std::this_thread::sleep_for(warmup);
+    if (waitpid(server, nullptr, WNOHANG) == server)
+    {
+        result.failure = "server exited during startup";
+        return result;
+    }
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+    {
+        stop(server);
+        result.failure = "pipe failed";
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ProcessSampler sampler(server);
+    pid_t load_test = spawn(load_cmd, pipe_fds[1], -1);
+    close(pipe_fds[1]);
+    if (load_test < 0)
+    {
+        result.failure = "cannot start " + load_cmd[0] + ": " + std::strerror(errno);
+        close(pipe_fds[0]);
+        sampler.finish(result);
+        stop(server);
+        return result;
+    }
+
+    std::string output;
+    char buffer[4096];
+    ssize_t length;
+    while ((length = read(pipe_fds[0], buffer, sizeof(buffer))) > 0)
+    {
+        output.append(buffer, static_cast<size_t>(length));
+    }
+    close(pipe_fds[0]);
+
+    int status = 0;
+    waitpid(load_test, &status, 0);
+    result.duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    sampler.finish(result);
+    stop(server);
+
+    parse_load_test_output(output, result);
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && result.samples > 0;
+    if (!result.ok)
+    {
+        result.failure = result.samples > 0 ? "load test exit status " + std::to_string(WEXITSTATUS(status)) : "no latency samples";
+    }
+    return result;
+}
+
+std::string json_escape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        out << "  {\"architecture\": \"" << r.architecture << "\", \"clients\": " << r.clients << ", \"payload\": " << r.payload
+            << ", \"threads\": " << r.threads << ", \"repetition\": " << r.repetition << ", \"ok\": " << (r.ok ? "true" : "false")
+            << ", \"failure\": \"" << json_escape(r.failure) << "\""
+            << ", \"errors\": " << r.errors << ", \"samples\": " << r.samples
+            << ", \"min_us\": " << r.min << ", \"avg_us\": " << r.avg << ", \"p50_us\": " << r.p50 << ", \"p90_us\": " << r.p90
+            << ", \"p99_us\": " << r.p99 << ", \"p99_9_us\": " << r.p999 << ", \"p99_99_us\": " << r.p9999 << ", \"max_us\": " << r.max
+            << ", \"server_cpu_percent\": " << r.cpu_percent << ", \"server_peak_rss_kb\": " << r.peak_rss_kb
+            << ", \"server_avg_rss_kb\": " << r.avg_rss_kb << ", \"duration_ms\": " << r.duration_ms << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+// RFC 4180: quoted, with embedded quotes doubled
+std::string csv_quote(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"')
+        {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void write_csv(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "architecture,clients,payload,threads,repetition,ok,failure,errors,samples,min_us,avg_us,p50_us,p90_us,p99_us,p99_9_us,p99_99_us,max_us,"
+           "server_cpu_percent,server_peak_rss_kb,server_avg_rss_kb,duration_ms\n";
+    for (const Result& r : results)
+    {
+        out << r.architecture << "," << r.clients << "," << r.payload << "," << r.threads << "," << r.repetition << "," << (r.ok ? 1 : 0)
+            << "," << csv_quote(r.failure) << "," << r.errors << "," << r.samples << "," << r.min << "," << r.avg << "," << r.p50 << "," << r.p90
+            << "," << r.p99 << "," << r.p999 << "," << r.p9999 << "," << r.max << "," << r.cpu_percent << "," << r.peak_rss_kb << ","
+            << r.avg_rss_kb << "," << r.duration_ms << "\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    CommandLine args(argc, argv);
+    if (args.has("help"))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--architectures=a,b] [--clients=10,100,1000] [--payloads=0] [--threads=1]" << std::endl;
+        std::cerr << "       [--repeat=3] [--json=FILE] [--csv=FILE] [--bin-dir=DIR] [--port=7777] [--warmup-ms=500]" << std::endl;
+        std::cerr << "       [--server-args=\"...\"] [--load-args=\"...\"]" << std::endl;
+        std::cerr << "  --architectures=LIST  subset of:";
+        for (auto& arch : architectures)
+        {
+            std::cerr << " " << arch.name;
+        }
+        std::cerr << " (default all)" << std::endl;
+        std::cerr << "  --threads=LIST        server thread counts, for servers that take --threads" << std::endl;
+        std::cerr << "  --server-args/--load-args  extra space-separated arguments, e.g. --load-args=\"--coroutines --binary\"" << std::endl;
+        return 1;
+    }
+
+    std::string bin_dir = args.get("bin-dir");
+    if (bin_dir.empty())
+    {
+        // Every target builds into the same directory as this driver
+        std::string self = argv[0];
+        size_t slash = self.rfind('/');
+        bin_dir = slash == std::string::npos ? "." : self.substr(0, slash);
+    }
+
+    std::vector<std::string> selected = split(args.get("architectures"), ',');
+    std::vector<int> client_counts = parse_int_list(args.get("clients", "10,100,1000"));
+    std::vector<int> payloads = parse_int_list(args.get("payloads", "0"));
+    std::vector<int> thread_counts = parse_int_list(args.get("threads", "1"));
+    int repeat = static_cast<int>(std::max(1LL, args.getInt("repeat", 3)));
+    int port = static_cast<int>(args.getInt("port", 7777));
+    auto warmup = std::chrono::milliseconds(args.getInt("warmup-ms", 500));
+    std::vector<std::string> server_args = split(args.get("server-args"), ' ');
+    std::vector<std::string> load_args = split(args.get("load-args"), ' ');
+
+    std::vector<Result> results;
+    int run = 0;
+    for (auto& arch : architectures)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), arch.name) == selected.end())
+        {
+            continue;
+        }
+
+        for (int clients : client_counts)
+        {
+            for (int payload : payloads)
+            {
+                if (payload > 0 && !arch.supports_payload)
+                {
+                    std::cout << "[" << arch.name << "] skipping payload " << payload << " (not supported by " << arch.load_test << ")" << std::endl;
+                    continue;
+                }
+
+                std::vector<int> cell_threads = arch.uses_threads ? thread_counts : std::vector<int>{0};
+                for (int threads : cell_threads)
+                {
+                    for (int repetition = 1; repetition <= repeat; ++repetition)
+                    {
+                        // A fresh port per run, so no run trips over the previous one's lingering sockets
+                        int run_port = port + (run++ % 1000);
+                        Result r = run_cell(arch, bin_dir, run_port, clients, payload, threads, repetition, server_args, load_args, warmup);
+
+                        std::cout << "[" << arch.name << " clients=" << clients << " payload=" << payload;
+                        if (threads > 0)
+                        {
+                            std::cout << " threads=" << threads;
+                        }
+                        std::cout << " #" << repetition << "] ";
+                        if (r.ok)
+                        {
+                            std::cout << "p50=" << r.p50 << "us p99=" << r.p99 << "us p99.9=" << r.p999 << "us errors=" << r.errors
+                                      << " server cpu=" << r.cpu_percent << "% rss=" << r.peak_rss_kb / 1024 << "MB" << std::endl;
+                        }
+                        else
+                        {
+                            std::cout << "FAILED: " << r.failure << std::endl;
+                        }
+                        results.push_back(r);
+                    }
+                }
+            }
+        }
+    }
+
+    std::string json_path = args.get("json", "benchmark.json");
+    std::ofstream json(json_path);
+    write_json(json, results);
+    std::cout << "Wrote " << results.size() << " runs to " << json_path;
+
+    std::string csv_path = args.get("csv");
+    if (!csv_path.empty())
+    {
+        std::ofstream csv(csv_path);
+        write_csv(csv, results);
+        std::cout << " and " << csv_path;
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+// Small argv helper shared by the servers and load tests.
+// Positional arguments keep their original meaning; optional "--name=value"
+// (or bare "--name") flags can be mixed in anywhere to switch on extra modes.
+class CommandLine
+{
+public:
+    CommandLine(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) == 0)
+            {
+                size_t eq = arg.find('=');
+                if (eq == std::string::npos)
+                {
+                    flags[arg.substr(2)] = "";
+                }
+                else
+                {
+                    flags[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+                }
+            }
+            else
+            {
+                positional.push_back(arg);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return positional.size();
+    }
+
+    const std::string& operator[](size_t index) const
+    {
+        return positional.at(index);
+    }
+
+    bool has(const std::string& name) const
+    {
+        return flags.find(name) != flags.end();
+    }
+
+    std::string get(const std::string& name, const std::string& fallback = "") const
+    {
+        auto it = flags.find(name);
+        return (it == flags.end() || it->second.empty()) ? fallback : it->second;
+    }
+
+    long long getInt(const std::string& name, long long fallback) const
+    {
+        auto it = flags.find(name);
+        return (it == flags.end() || it->second.empty()) ? fallback : std::stoll(it->second);
+    }
+
+    double getDouble(const std::string& name, double fallback) const
+    {
+        auto it = flags.find(name);
+        return (it == flags.end() || it->second.empty()) ? fallback : std::stod(it->second);
+    }
+
+private:
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> flags;
+};
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <boost/asio.hpp>
+#include "LatencyHistogram.hpp"
+#include "LatencyTimeSeries.hpp"
+#include "CpuAffinity.hpp"
+
+// Runs thousands of simulated load test clients as coroutines on a few threads.
+// Every thread owns one single-threaded io_context (a Worker) and clients are
+// spread round-robin over them, so a client's coroutine, its socket and the
+// worker's histogram are only ever touched by one thread and need no locking.
+//
+// The start barrier replaces the std::latch of the thread-per-client mode:
+// arrive_and_wait() suspends the coroutine instead of blocking its thread.
+class CoroutineClientPool
+{
+public:
+    struct Worker
+    {
+        boost::asio::io_context ctx{1};
+        // Never fires on its own, cancelled once every client has arrived
+        boost::asio::steady_timer start_signal{ctx, std::chrono::steady_clock::time_point::max()};
+        bool started = false;
+        LatencyHistogram histogram;
+        // Only sized (and filled) in open-loop mode
+        LatencyTimeSeries series;
+    };
+
+    CoroutineClientPool(size_t thread_count, int clients, std::vector<int> cpus = {})
+        : remaining(clients), cpus(std::move(cpus))
+    {
+        for (size_t i = 0; i < std::max<size_t>(thread_count, 1); ++i)
+        {
+            workers.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    Worker& worker_for(int client)
+    {
+        return *workers[static_cast<size_t>(client) % workers.size()];
+    }
+
+    // Resumes once every client has either arrived or given up via arrive().
+    // Must be awaited on the worker's own io_context.
+    boost::asio::awaitable<void> arrive_and_wait(Worker& worker)
+    {
+        arrive();
+        if (!worker.started)
+        {
+            boost::system::error_code ec;
+            co_await worker.start_signal.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+    }
+
+    // Counts a client as arrived without waiting, e.g. when it failed to connect
+    void arrive()
+    {
+        if (--remaining == 0)
+        {
+            start = std::chrono::steady_clock::now();
+            for (auto& worker : workers)
+            {
+                boost::asio::post(worker->ctx, [w = worker.get()]
+                {
+                    w->started = true;
+                    w->start_signal.cancel();
+                });
+            }
+        }
+    }
+
+    // Runs every worker on its own thread, pinned round-robin to 'cpus' if given,
+    // until all spawned client coroutines have finished.
+    void run()
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            threads.emplace_back([this, i]
+            {
+                if (!cpus.empty())
+                {
+                    pin_this_thread(cpus[i % cpus.size()]);
+                }
+                workers[i]->ctx.run();
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+
+    // When the start barrier opened. Only valid once arrive_and_wait() has resumed.
+    std::chrono::steady_clock::time_point start_time() const
+    {
+        return start;
+    }
+
+    void merge_into(LatencyHistogram& total) const
+    {
+        for (auto& worker : workers)
+        {
+            total.merge(worker->histogram);
+        }
+    }
+
+    void merge_into(LatencyTimeSeries& total) const
+    {
+        for (auto& worker : workers)
+        {
+            total.merge(worker->series);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<int> remaining;
+    std::chrono::steady_clock::time_point start;
+    std::vector<int> cpus;
+};
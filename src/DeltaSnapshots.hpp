@@ -0,0 +1,551 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "WireProtocol.hpp"
+
+// Delta-compressed world snapshots for the UDP servers' tick mode.
+//
+// Every sending client is an entity, keyed by its wire sender id, whose state is up to
+// max_words 32-bit words: the sequence and timestamp of its latest frame followed by
+// that frame's payload. Once per tick the server freezes the world into a numbered
+// snapshot and sends each client only the words that changed since the last snapshot
+// the client acknowledged -- or everything, while it has acknowledged none that is still
+// kept. Clients that share a baseline share one encoding, and clients that are already
+// up to date get nothing.
+//
+// Snapshot frame: wire::MessageType::Snapshot, sequence = snapshot id, timestamp = server time
+//   payload  offset  size
+//              0       4  baseline snapshot id the records apply to, 0 = full snapshot
+//              4       2  part index
+//              6       2  part count
+//              8       -  entity records
+//   record: varint entity id, u8 word count (0 = entity removed), varint change mask,
+//           then one little-endian u32 per set mask bit, lowest bit first
+//
+// A snapshot larger than one datagram is split into parts of whole records, so every
+// part can be applied on its own. Clients acknowledge a snapshot once they have all its
+// parts with a wire::MessageType::SnapshotAck frame whose sequence is the snapshot id.
+namespace delta
+{
+    constexpr size_t max_words = 64;
+    // sequence, timestamp low, timestamp high
+    constexpr size_t header_words = 3;
+    constexpr size_t snapshot_header_size = 8;
+    // Fits the 1024-byte receive buffers of the servers and load tests
+    constexpr size_t max_datagram_size = 1024;
+    // Most snapshots a server keeps as baselines. SnapshotReceiver keeps as many of its
+    // own, so every baseline the server can pick is still known to the client.
+    constexpr size_t max_snapshot_history = 64;
+
+    struct Entity
+    {
+        uint32_t id = 0;
+        uint32_t count = 0; // 0 = absent
+        std::array<uint32_t, max_words> words{};
+
+        int64_t timestamp() const
+        {
+            return static_cast<int64_t>(static_cast<uint64_t>(words[1]) | (static_cast<uint64_t>(words[2]) << 32));
+        }
+    };
+
+    // State carried by a Broadcast or PositionedBroadcast frame. Payload bytes beyond
+    // max_words - header_words words are not part of the state.
+    inline Entity entity_of(wire::MessageView frame)
+    {
+        Entity entity;
+        entity.id = frame.sender();
+        entity.words[0] = frame.sequence();
+        entity.words[1] = static_cast<uint32_t>(static_cast<uint64_t>(frame.timestamp()));
+        entity.words[2] = static_cast<uint32_t>(static_cast<uint64_t>(frame.timestamp()) >> 32);
+
+        size_t payload = std::min(frame.payload_size(), (max_words - header_words) * 4);
+        size_t count = header_words;
+        for (size_t offset = 0; offset < payload; offset += 4, ++count)
+        {
+            char word[4] = {};
+            std::memcpy(word, frame.payload() + offset, std::min<size_t>(4, payload - offset));
+            entity.words[count] = wire::detail::load<uint32_t>(word);
+        }
+        entity.count = static_cast<uint32_t>(count);
+        return entity;
+    }
+
+    namespace detail
+    {
+        inline void put_varint(std::string& out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        inline bool get_varint(const char*& p, const char* end, uint64_t& value)
+        {
+            value = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7)
+            {
+                uint8_t byte = static_cast<uint8_t>(*p++);
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (byte < 0x80)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    // Appends the record that turns 'base' into 'current' (nullptr = absent), nothing if they are equal
+    inline void encode_record(std::string& out, uint32_t id, const Entity* base, const Entity* current)
+    {
+        if (current == nullptr)
+        {
+            detail::put_varint(out, id);
+            out.push_back(0);
+            detail::put_varint(out, 0);
+            return;
+        }
+
+        uint64_t mask = 0;
+        for (size_t i = 0; i < current->count; ++i)
+        {
+            if (base == nullptr || i >= base->count || base->words[i] != current->words[i])
+            {
+                mask |= uint64_t(1) << i;
+            }
+        }
+        if (mask == 0 && base != nullptr && base->count == current->count)
+        {
+            return;
+        }
+
+        detail::put_varint(out, id);
+        out.push_back(static_cast<char>(current->count));
+        detail::put_varint(out, mask);
+        for (size_t i = 0; i < current->count; ++i)
+        {
+            if (mask & (uint64_t(1) << i))
+            {
+                char word[4];
+                wire::detail::store<uint32_t>(word, current->words[i]);
+                out.append(word, 4);
+            }
+        }
+    }
+
+    // Applies one record to 'entity', the receiver's copy at the record's baseline
+    inline void apply(Entity& entity, uint32_t count, uint64_t mask, const uint32_t* values)
+    {
+        entity.count = count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (mask & (uint64_t(1) << i))
+            {
+                entity.words[i] = *values++;
+            }
+        }
+    }
+
+    struct PartHeader
+    {
+        uint32_t snapshot = 0;
+        uint32_t baseline = 0;
+        uint16_t part = 0;
+        uint16_t parts = 0;
+    };
+
+    // Calls on_record(id, count, mask, const uint32_t* values) for every record of a
+    // Snapshot frame. Returns false, possibly after some records, if it is malformed.
+    template <typename OnRecord>
+    bool read_snapshot(wire::MessageView frame, PartHeader& header, OnRecord&& on_record)
+    {
+        if (frame.type() != wire::MessageType::Snapshot || frame.payload_size() < snapshot_header_size)
+        {
+            return false;
+        }
+        const char* p = frame.payload();
+        const char* end = p + frame.payload_size();
+        header.snapshot = frame.sequence();
+        header.baseline = wire::detail::load<uint32_t>(p);
+        header.part = wire::detail::load<uint16_t>(p + 4);
+        header.parts = wire::detail::load<uint16_t>(p + 6);
+        p += snapshot_header_size;
+
+        std::array<uint32_t, max_words> values;
+        while (p < end)
+        {
+            uint64_t id, mask;
+            if (!detail::get_varint(p, end, id) || p == end)
+            {
+                return false;
+            }
+            uint32_t count = static_cast<uint8_t>(*p++);
+            if (count > max_words || !detail::get_varint(p, end, mask))
+            {
+                return false;
+            }
+            size_t changed = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (mask & (uint64_t(1) << i))
+                {
+                    if (end - p < 4)
+                    {
+                        return false;
+                    }
+                    values[changed++] = wire::detail::load<uint32_t>(p);
+                    p += 4;
+                }
+            }
+            on_record(static_cast<uint32_t>(id), count, mask, values.data());
+        }
+        return true;
+    }
+
+    // Server side. update() and ack() are called by the receiving threads and publish()
+    // by the ticker; one mutex serializes them, the sends happen outside it.
+    template <typename Client>
+    class SnapshotHistory
+    {
+    public:
+        struct Group
+        {
+            uint32_t baseline = 0;
+            std::vector<std::string> datagrams;
+            std::vector<Client> clients;
+        };
+
+        // 'history' snapshots (at most max_snapshot_history) are kept as baselines;
+        // clients further behind get full snapshots
+        explicit SnapshotHistory(size_t history = 32)
+            : history(std::clamp<size_t>(history, 1, max_snapshot_history))
+        {
+        }
+
+        // Makes the frame its sender's entity state; frames of other types are ignored
+        void update(wire::MessageView frame)
+        {
+            if (frame.type() != wire::MessageType::Broadcast && frame.type() != wire::MessageType::PositionedBroadcast)
+            {
+                return;
+            }
+            Entity entity = entity_of(frame);
+            std::lock_guard<std::mutex> lock(mutex);
+            world[entity.id] = entity;
+            dirty = true;
+        }
+
+        // Handles every frame of a datagram a client sent: acknowledgements and state updates.
+        // Malformed datagrams are dropped.
+        void receive(const Client& client, const char* data, size_t size)
+        {
+            try
+            {
+                wire::for_each_frame(data, size, [&](wire::MessageView frame)
+                {
+                    if (frame.type() == wire::MessageType::SnapshotAck)
+                    {
+                        ack(client, frame.sequence());
+                    }
+                    else
+                    {
+                        update(frame);
+                    }
+                });
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        void remove(uint32_t entity)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dirty |= world.erase(entity) > 0;
+        }
+
+        void ack(const Client& client, uint32_t snapshot)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (snapshot == 0 || snapshots.empty() || snapshot > snapshots.back().id)
+            {
+                return;
+            }
+            uint32_t& acked = acks[client];
+            acked = std::max(acked, snapshot);
+        }
+
+        void forget(const Client& client)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            acks.erase(client);
+        }
+
+        // Freezes the world into a new snapshot if it changed and encodes it once per
+        // distinct baseline among the 'clients' that are not up to date yet. The groups
+        // stay valid until the next call.
+        template <typename Clients>
+        const std::vector<Group>& publish(const Clients& clients)
+        {
+            groups.clear();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (dirty)
+            {
+                Snapshot snapshot;
+                snapshot.id = next_id++;
+                snapshot.entities.reserve(world.size());
+                for (const auto& [id, entity] : world)
+                {
+                    snapshot.entities.push_back(entity);
+                }
+                snapshots.push_back(std::move(snapshot));
+                if (snapshots.size() > history)
+                {
+                    snapshots.pop_front();
+                }
+                dirty = false;
+            }
+            if (snapshots.empty())
+            {
+                return groups;
+            }
+
+            const Snapshot& latest = snapshots.back();
+            std::map<uint32_t, size_t> group_of_baseline;
+            for (const Client& client : clients)
+            {
+                auto acked = acks.find(client);
+                uint32_t baseline = acked == acks.end() ? 0 : acked->second;
+                if (baseline == latest.id)
+                {
+                    continue;
+                }
+                if (find(baseline) == nullptr)
+                {
+                    baseline = 0;
+                }
+                auto [it, inserted] = group_of_baseline.try_emplace(baseline, groups.size());
+                if (inserted)
+                {
+                    groups.emplace_back();
+                    groups.back().baseline = baseline;
+                    encode(find(baseline), latest, groups.back().datagrams);
+                }
+                groups[it->second].clients.push_back(client);
+            }
+            return groups;
+        }
+
+    private:
+        struct Snapshot
+        {
+            uint32_t id = 0;
+            std::vector<Entity> entities; // sorted by id
+        };
+
+        const Snapshot* find(uint32_t id) const
+        {
+            if (id == 0 || snapshots.empty() || id < snapshots.front().id || id > snapshots.back().id)
+            {
+                return nullptr;
+            }
+            return &snapshots[id - snapshots.front().id];
+        }
+
+        // Diffs two sorted entity lists and cuts the records into datagrams
+        static void encode(const Snapshot* base, const Snapshot& current, std::vector<std::string>& datagrams)
+        {
+            constexpr size_t budget = max_datagram_size - wire::header_size - snapshot_header_size;
+            std::vector<std::string> parts(1);
+            std::string record;
+            auto add = [&](uint32_t id, const Entity* from, const Entity* to)
+            {
+                record.clear();
+                encode_record(record, id, from, to);
+                if (record.empty())
+                {
+                    return;
+                }
+                if (parts.back().size() + record.size() > budget)
+                {
+                    parts.emplace_back();
+                }
+                parts.back() += record;
+            };
+
+            static const std::vector<Entity> none;
+            const std::vector<Entity>& before = base ? base->entities : none;
+            size_t i = 0, j = 0;
+            while (i < before.size() || j < current.entities.size())
+            {
+                if (j == current.entities.size() || (i < before.size() && before[i].id < current.entities[j].id))
+                {
+                    add(before[i].id, &before[i], nullptr);
+                    ++i;
+                }
+                else if (i == before.size() || current.entities[j].id < before[i].id)
+                {
+                    add(current.entities[j].id, nullptr, &current.entities[j]);
+                    ++j;
+                }
+                else
+                {
+                    add(current.entities[j].id, &before[i], &current.entities[j]);
+                    ++i;
+                    ++j;
+                }
+            }
+
+            long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+            for (size_t part = 0; part < parts.size(); ++part)
+            {
+                std::string payload(snapshot_header_size, '\0');
+                wire::detail::store<uint32_t>(payload.data(), base ? base->id : 0);
+                wire::detail::store<uint16_t>(payload.data() + 4, static_cast<uint16_t>(part));
+                wire::detail::store<uint16_t>(payload.data() + 6, static_cast<uint16_t>(parts.size()));
+                payload += parts[part];
+                datagrams.push_back(wire::encode(wire::MessageType::Snapshot, 0, current.id, now, payload.data(), payload.size()));
+            }
+        }
+
+        size_t history;
+        std::mutex mutex;
+        std::map<uint32_t, Entity> world;
+        bool dirty = false;
+        uint32_t next_id = 1;
+        std::deque<Snapshot> snapshots;
+        std::map<Client, uint32_t> acks;
+        std::vector<Group> groups;
+    };
+
+    // Client side: follows one client's own entity through the snapshots and decides
+    // what to acknowledge. Other entities' records are only counted, not stored.
+    class SnapshotReceiver
+    {
+    public:
+        explicit SnapshotReceiver(uint32_t own_id)
+            : own_id(own_id)
+        {
+        }
+
+        // Calls on_record(sent_ts) for every record of the frame: the timestamp of this
+        // client's own latest message the first time it shows up, -1 for anything else
+        template <typename OnRecord>
+        void receive(wire::MessageView frame, OnRecord&& on_record)
+        {
+            PartHeader header;
+            Entity own;
+            bool own_changed = false;
+            bool ok = read_snapshot(frame, header, [&](uint32_t id, uint32_t count, uint64_t mask, const uint32_t* values)
+            {
+                if (id != own_id)
+                {
+                    on_record(-1);
+                    return;
+                }
+                const Entity* base = baseline_own(header.baseline);
+                own = base ? *base : Entity{};
+                apply(own, count, mask, values);
+                own_changed = true;
+                if (count >= header_words && own.timestamp() > last_timestamp)
+                {
+                    last_timestamp = own.timestamp();
+                    on_record(last_timestamp);
+                }
+                else
+                {
+                    on_record(-1);
+                }
+            });
+            if (!ok || header.parts == 0 || header.part >= header.parts)
+            {
+                return;
+            }
+
+            if (header.snapshot == latest_complete)
+            {
+                ack = header.snapshot; // our acknowledgement got lost, repeat it
+                return;
+            }
+            if (header.snapshot < latest_complete || header.snapshot < pending)
+            {
+                return;
+            }
+            if (header.snapshot > pending)
+            {
+                pending = header.snapshot;
+                pending_baseline = header.baseline;
+                parts_seen.assign(header.parts, false);
+                missing = header.parts;
+                pending_own.reset();
+            }
+            if (own_changed)
+            {
+                pending_own = own;
+            }
+            if (header.part < parts_seen.size() && !parts_seen[header.part])
+            {
+                parts_seen[header.part] = true;
+                if (--missing == 0)
+                {
+                    complete();
+                }
+            }
+        }
+
+        // Snapshot id to acknowledge now, 0 if none
+        uint32_t take_ack()
+        {
+            return std::exchange(ack, 0);
+        }
+
+    private:
+        const Entity* baseline_own(uint32_t baseline) const
+        {
+            auto it = own_history.find(baseline);
+            return it == own_history.end() ? nullptr : &it->second;
+        }
+
+        void complete()
+        {
+            // Without a record of our own the entity is unchanged since the baseline
+            const Entity* base = baseline_own(pending_baseline);
+            own_history[pending] = pending_own ? *pending_own : (base ? *base : Entity{});
+            while (own_history.size() > kept_snapshots)
+            {
+                own_history.erase(own_history.begin());
+            }
+            latest_complete = pending;
+            ack = pending;
+        }
+
+        static constexpr size_t kept_snapshots = max_snapshot_history;
+
+        uint32_t own_id;
+        int64_t last_timestamp = -1;
+        uint32_t latest_complete = 0;
+        uint32_t pending = 0;
+        uint32_t pending_baseline = 0;
+        std::vector<bool> parts_seen;
+        size_t missing = 0;
+        std::optional<Entity> pending_own;
+        std::map<uint32_t, Entity> own_history;
+        uint32_t ack = 0;
+    };
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "WireProtocol.hpp"
+
+// Area-of-interest management: instead of going to every connection, a message goes
+// only to the clients within 'radius' of its sender.
+//
+// Clients are bucketed into a uniform grid of square cells hashed by their integer
+// coordinates, so the world needs no bounds. With the default cell size equal to the
+// radius, a query looks at the 3x3 cells around the sender, and the work per message
+// is proportional to the clients nearby instead of to everyone connected.
+
+struct Position
+{
+    float x = 0;
+    float y = 0;
+};
+
+// Positions come from clients. Anything further out is rejected before it reaches the
+// grid, so cell coordinates always fit an int64 and stay distinct in cell_key's 32 bits
+// for any cell size above 2 * max_coordinate / 2^32.
+constexpr float max_coordinate = 1e6f;
+
+inline bool valid_coordinate(float value)
+{
+    return std::isfinite(value) && std::fabs(value) <= max_coordinate;
+}
+
+// Smallest cell size the grid accepts for 'radius': a query scans at most 33x33 cells,
+// and cell keys stay distinct over the whole coordinate range
+inline float min_cell_size(float radius)
+{
+    return std::max(radius / 16, 2 * max_coordinate / 4294967296.0f);
+}
+
+// Reads the sender position a message carries, if it carries one:
+//   text:   "timestamp|@x,y|...|id\n"
+//   binary: a wire::MessageType::PositionedBroadcast frame
+inline bool read_position(const char* data, size_t size, bool binary, Position& out)
+{
+    if (binary)
+    {
+        if (size < wire::header_size || wire::MessageView(data).length() > size)
+        {
+            return false;
+        }
+        return wire::load_position(wire::MessageView(data), out.x, out.y) && valid_coordinate(out.x) && valid_coordinate(out.y);
+    }
+
+    std::string_view text(data, size);
+    size_t at = text.find("|@");
+    if (at == std::string_view::npos)
+    {
+        return false;
+    }
+    // strtof stops at the ',' and the '|' that follow the numbers
+    std::string field(text.substr(at + 2, text.find('|', at + 2) - (at + 2)));
+    char* end = nullptr;
+    out.x = std::strtof(field.c_str(), &end);
+    if (*end != ',')
+    {
+        return false;
+    }
+    const char* y_begin = end + 1;
+    out.y = std::strtof(y_begin, &end);
+    return end != y_begin && *end == '\0' && valid_coordinate(out.x) && valid_coordinate(out.y);
+}
+
+// Load test side: where client 'id' is 'seconds' into the run. Every client starts at a
+// fixed pseudo-random spot of the world square and moves in a straight line at 'speed'
+// units/s, bouncing off the edges, so positions need no state and no coordination.
+inline Position simulated_position(int id, double seconds, float world, float speed)
+{
+    // Golden-ratio sequences spread start points and headings evenly over any client count
+    auto fraction = [](double v) { return v - std::floor(v); };
+    double start_x = fraction(id * 0.6180339887) * world;
+    double start_y = fraction(id * 0.7548776662) * world;
+    double heading = fraction(id * 0.5698402910) * 2 * 3.14159265358979;
+
+    // Unfolding the bounce: a triangle wave with period 2 * world
+    auto bounce = [world](double v)
+    {
+        double t = std::fmod(std::fabs(v), 2.0 * world);
+        return static_cast<float>(t <= world ? t : 2.0 * world - t);
+    };
+    double distance = speed * seconds;
+    return Position{bounce(start_x + std::cos(heading) * distance), bounce(start_y + std::sin(heading) * distance)};
+}
+
+// The "@x,y" field of a text message
+inline std::string format_position(Position position)
+{
+    char text[48];
+    int length = std::snprintf(text, sizeof(text), "@%.2f,%.2f", position.x, position.y);
+    return std::string(text, static_cast<size_t>(length));
+}
+
+// Thread-safe: one mutex guards the grid, and moving the sender and collecting its
+// neighbours happen under a single lock acquisition. Sends happen outside it.
+template <typename Key, typename Hash = std::hash<Key>>
+class InterestGrid
+{
+public:
+    // cell_size <= 0 uses the radius; smaller ones are raised to min_cell_size(radius)
+    explicit InterestGrid(float radius, float cell_size = 0)
+        : radius(radius), cell_size(std::max(cell_size > 0 ? cell_size : radius, min_cell_size(radius)))
+    {
+    }
+
+    // Moves 'key' (inserting it on first sight) to 'position' and appends every client
+    // within the radius of that position, the sender included, to 'recipients'.
+    void move_and_collect(const Key& key, Position position, std::vector<Key>& recipients)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        move(key, position);
+
+        int64_t x0 = cell_of(position.x - radius), x1 = cell_of(position.x + radius);
+        int64_t y0 = cell_of(position.y - radius), y1 = cell_of(position.y + radius);
+        float radius_squared = radius * radius;
+        for (int64_t cx = x0; cx <= x1; ++cx)
+        {
+            for (int64_t cy = y0; cy <= y1; ++cy)
+            {
+                auto cell = cells.find(cell_key(cx, cy));
+                if (cell == cells.end())
+                {
+                    continue;
+                }
+                for (const Member& member : cell->second)
+                {
+                    float dx = member.position.x - position.x;
+                    float dy = member.position.y - position.y;
+                    if (dx * dx + dy * dy <= radius_squared)
+                    {
+                        recipients.push_back(member.key);
+                    }
+                }
+            }
+        }
+    }
+
+    void remove(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            unlink(it->second);
+            entries.erase(it);
+        }
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t cell;
+        size_t slot; // index in the cell's member list
+    };
+
+    // Members keep a copy of their position, so a query never leaves the cell's vector
+    struct Member
+    {
+        Key key;
+        Position position;
+    };
+
+    void move(const Key& key, Position position)
+    {
+        uint64_t cell = cell_key(cell_of(position.x), cell_of(position.y));
+        auto [it, inserted] = entries.try_emplace(key, Entry{cell, 0});
+        Entry& entry = it->second;
+        if (!inserted && entry.cell == cell)
+        {
+            cells[cell][entry.slot].position = position;
+            return;
+        }
+        if (!inserted)
+        {
+            unlink(entry);
+        }
+        std::vector<Member>& members = cells[cell];
+        entry.cell = cell;
+        entry.slot = members.size();
+        members.push_back(Member{key, position});
+    }
+
+    // Swap-removes the entry's member from its cell and fixes the moved member's slot
+    void unlink(const Entry& entry)
+    {
+        auto cell = cells.find(entry.cell);
+        std::vector<Member>& members = cell->second;
+        if (entry.slot + 1 != members.size())
+        {
+            members[entry.slot] = std::move(members.back());
+            entries.find(members[entry.slot].key)->second.slot = entry.slot;
+        }
+        members.pop_back();
+        if (members.empty())
+        {
+            cells.erase(cell);
+        }
+    }
+
+    int64_t cell_of(float coordinate) const
+    {
+        return static_cast<int64_t>(std::floor(coordinate / cell_size));
+    }
+
+    static uint64_t cell_key(int64_t cx, int64_t cy)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    }
+
+    float radius;
+    float cell_size;
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Entry, Hash> entries;
+    std::unordered_map<uint64_t, std::vector<Member>> cells;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <iomanip>
+#include <bit>
+
+// Log-linear latency histogram in the spirit of HdrHistogram.
+// Values below 128 get one exact bucket each; every power of two above that is
+// split into 128 linear sub-buckets, so any recorded value is reported within 1/128
+// (< 0.8%) of its true value while the whole range up to max_value fits in a few
+// thousand counters. Recording is a couple of shifts and one increment.
+//
+// Not thread-safe on purpose: every client thread records into its own histogram
+// without any lock, and the per-thread histograms are merged once at the end.
+class LatencyHistogram
+{
+public:
+    static constexpr int sub_bucket_bits = 7;
+    static constexpr int64_t sub_bucket_count = int64_t(1) << sub_bucket_bits;
+    // Larger values are counted in the top bucket (max() stays exact)
+    static constexpr int64_t max_value = (int64_t(1) << 27) - 1; // ~134 s in microseconds
+
+    LatencyHistogram()
+        : counts(index_of(max_value) + 1, 0)
+    {
+    }
+
+    void record(int64_t value)
+    {
+        value = std::max<int64_t>(value, 0);
+        counts[index_of(std::min(value, max_value))]++;
+        total++;
+        sum += value;
+        min_seen = std::min(min_seen, value);
+        max_seen = std::max(max_seen, value);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        min_seen = std::min(min_seen, other.min_seen);
+        max_seen = std::max(max_seen, other.max_seen);
+    }
+
+    void reset()
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        min_seen = std::numeric_limits<int64_t>::max();
+        max_seen = 0;
+    }
+
+    uint64_t count() const { return total; }
+    int64_t min() const { return total ? min_seen : 0; }
+    int64_t max() const { return max_seen; }
+    double mean() const { return total ? static_cast<double>(sum) / total : 0.0; }
+
+    // Smallest recorded value v such that 'percentile' percent of all values are <= v,
+    // reported as the highest value equivalent to its bucket.
+    int64_t percentile(double percentile) const
+    {
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+        target = std::clamp<uint64_t>(target, 1, total);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            seen += counts[i];
+            if (seen >= target)
+            {
+                return std::min(highest_equivalent(i), max_seen);
+            }
+        }
+        return max_seen;
+    }
+
+    // Min/Max/Avg line followed by the tail percentiles
+    void print_summary(std::ostream& out, const char* unit = "us") const
+    {
+        out << "Latency (" << unit << ") -> Min: " << min() << ", Max: " << max() << ", Avg: " << mean() << std::endl;
+        out << "Percentiles (" << unit << ") -> p50: " << percentile(50) << ", p90: " << percentile(90)
+            << ", p99: " << percentile(99) << ", p99.9: " << percentile(99.9) << ", p99.99: " << percentile(99.99)
+            << " (" << total << " samples)" << std::endl;
+    }
+
+    // Full distribution, one line per non-empty bucket, in HdrHistogram's
+    // "Value Percentile TotalCount" layout so it can be plotted directly.
+    void print_distribution(std::ostream& out) const
+    {
+        out << std::setw(12) << "Value" << std::setw(14) << "Percentile" << std::setw(12) << "TotalCount" << std::endl;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (counts[i] == 0)
+            {
+                continue;
+            }
+            seen += counts[i];
+            out << std::setw(12) << std::min(highest_equivalent(i), max_seen)
+                << std::setw(14) << std::fixed << std::setprecision(6) << static_cast<double>(seen) / total
+                << std::setw(12) << seen << std::defaultfloat << std::endl;
+        }
+    }
+
+private:
+    static size_t index_of(int64_t value)
+    {
+        if (value < 2 * sub_bucket_count)
+        {
+            return static_cast<size_t>(value);
+        }
+        int shift = static_cast<int>(std::bit_width(static_cast<uint64_t>(value))) - 1 - sub_bucket_bits;
+        return static_cast<size_t>(shift * sub_bucket_count + (value >> shift));
+    }
+
+    static int64_t highest_equivalent(size_t index)
+    {
+        int64_t i = static_cast<int64_t>(index);
+        if (i < 2 * sub_bucket_count)
+        {
+            return i;
+        }
+        int64_t shift = i / sub_bucket_count - 1;
+        int64_t mantissa = i - shift * sub_bucket_count;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    int64_t sum = 0;
+    int64_t min_seen = std::numeric_limits<int64_t>::max();
+    int64_t max_seen = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <iomanip>
+#include "LatencyHistogram.hpp"
+
+// Per-second throughput and latency of an open-loop load test run.
+// Like LatencyHistogram it is filled by one thread and merged at the end.
+// Latencies are filed under the second their message was *scheduled* to be sent,
+// so a server that falls behind shows up as rising latency from that second on.
+class LatencyTimeSeries
+{
+public:
+    void resize(size_t seconds)
+    {
+        buckets.resize(seconds);
+    }
+
+    // A message left this client in 'second'
+    void record_sent(size_t second)
+    {
+        if (second < buckets.size())
+        {
+            buckets[second].sent++;
+        }
+    }
+
+    // Any broadcast message (own or not) arrived in 'second'
+    void record_received(size_t second)
+    {
+        if (second < buckets.size())
+        {
+            buckets[second].received++;
+        }
+    }
+
+    // The client's own message scheduled in 'second' came back after 'latency'
+    void record_latency(size_t second, int64_t latency)
+    {
+        if (second < buckets.size())
+        {
+            buckets[second].latency.record(latency);
+        }
+    }
+
+    void merge(const LatencyTimeSeries& other)
+    {
+        if (buckets.size() < other.buckets.size())
+        {
+            buckets.resize(other.buckets.size());
+        }
+        for (size_t i = 0; i < other.buckets.size(); ++i)
+        {
+            buckets[i].sent += other.buckets[i].sent;
+            buckets[i].received += other.buckets[i].received;
+            buckets[i].latency.merge(other.buckets[i].latency);
+        }
+    }
+
+    uint64_t total_sent() const
+    {
+        uint64_t total = 0;
+        for (auto& bucket : buckets)
+        {
+            total += bucket.sent;
+        }
+        return total;
+    }
+
+    uint64_t total_echoes() const
+    {
+        uint64_t total = 0;
+        for (auto& bucket : buckets)
+        {
+            total += bucket.latency.count();
+        }
+        return total;
+    }
+
+    // One row per second: messages sent, broadcast messages received, own echoes
+    // of the messages sent that second and their latency percentiles (us).
+    void print(std::ostream& out) const
+    {
+        out << std::setw(6) << "Second" << std::setw(10) << "Sent" << std::setw(12) << "Received" << std::setw(10) << "Echoes"
+            << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+            << std::setw(10) << "Max" << std::endl;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            const Second& s = buckets[i];
+            out << std::setw(6) << i << std::setw(10) << s.sent << std::setw(12) << s.received << std::setw(10) << s.latency.count()
+                << std::setw(10) << s.latency.percentile(50) << std::setw(10) << s.latency.percentile(90)
+                << std::setw(10) << s.latency.percentile(99) << std::setw(10) << s.latency.percentile(99.9)
+                << std::setw(10) << s.latency.max() << std::endl;
+        }
+    }
+
+private:
+    struct Second
+    {
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        LatencyHistogram latency;
+    };
+
+    std::vector<Second> buckets;
+};
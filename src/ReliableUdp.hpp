@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "WireProtocol.hpp"
+
+// Optional reliability layer for the UDP servers and load test, one Connection per peer.
+//
+// Every datagram is one packet frame (wire::MessageType::ReliablePacket) with its own
+// sequence number that piggybacks what the sender has received from the peer: the
+// newest packet sequence plus a 32-bit field for the 32 packets before it. Packets are
+// never resent as a whole. A message on the Reliable channel stays queued until a
+// packet carrying it is acknowledged and goes into the next packet again whenever the
+// retransmission timeout expires, so only what was actually lost is resent. Sequenced
+// messages are sent once and a receiver drops any that are older than the newest it
+// has delivered -- the right semantics for state that the next update replaces anyway.
+// The channels are independent, so a lost reliable message never holds back state.
+// A reliable message that runs out of attempts is abandoned, and every packet carries
+// the oldest reliable sequence the sender may still send, so the receiver skips the
+// abandoned ones instead of holding back everything after them. A packet is only
+// acknowledged once every reliable message in it was delivered or held.
+//
+// Packet: sender = local id, sequence = packet sequence, timestamp = send time (us)
+//   payload  offset  size
+//              0       4  ack       newest packet sequence received from the peer, 0 = none
+//              4       4  ack_bits  bit i set = packet ack - 1 - i was received too
+//              8       4  base      oldest reliable sequence still being sent, everything
+//                                   older was acknowledged or abandoned
+//             12       -  messages: u8 channel, u32 channel sequence, u16 length, bytes
+//
+// Sequence numbers are 32 bits and never wrap in practice, so they compare directly.
+namespace reliable
+{
+    enum class Channel : uint8_t
+    {
+        Reliable = 0,  // resent until acknowledged, delivered once and in order
+        Sequenced = 1, // sent once, delivered only if newer than anything delivered before
+    };
+
+    constexpr size_t ack_header_size = 12;
+    constexpr size_t message_header_size = 7;
+    // Fits the 1024-byte receive buffers of the servers and load tests
+    constexpr size_t max_packet_size = 1024;
+    constexpr size_t max_message_size = max_packet_size - wire::header_size - ack_header_size - message_header_size;
+
+    struct Stats
+    {
+        uint64_t packets_sent = 0;
+        uint64_t packets_received = 0;
+        uint64_t messages_delivered = 0;
+        uint64_t messages_resent = 0;
+        uint64_t messages_abandoned = 0; // reliable messages that ran out of attempts
+        uint64_t messages_skipped = 0;   // reliable messages the peer abandoned
+        uint64_t out_of_order = 0;       // reliable messages held back for an earlier one
+        uint64_t stale = 0;              // sequenced messages older than one already delivered
+    };
+
+    class Connection
+    {
+    public:
+        // Reliable messages are given up after 'max_attempts' sends, so a peer that
+        // vanished does not keep them queued forever
+        explicit Connection(uint32_t local_id = 0, int max_attempts = 10)
+            : local_id(local_id), max_attempts(max_attempts)
+        {
+        }
+
+        // Queues a message for the next packet. False if it can never fit in a packet.
+        bool send(Channel channel, const char* data, size_t size)
+        {
+            if (size > max_message_size)
+            {
+                return false;
+            }
+            if (channel == Channel::Reliable)
+            {
+                reliable_out.emplace(next_reliable, Outgoing{std::string(data, size)});
+                next_reliable++;
+            }
+            else
+            {
+                sequenced_out.emplace_back(next_sequenced++, std::string(data, size));
+            }
+            return true;
+        }
+
+        // Whether write_packet() has anything to write at 'now_us'
+        bool has_output(int64_t now_us) const
+        {
+            if (ack_owed || base_owed || !sequenced_out.empty())
+            {
+                return true;
+            }
+            return std::any_of(reliable_out.begin(), reliable_out.end(), [&](const auto& entry) { return due(entry.second, now_us); });
+        }
+
+        // Writes the next packet: the owed acknowledgement, queued sequenced messages and
+        // reliable messages that were never sent or timed out. False if there is nothing to send.
+        bool write_packet(std::string& out, int64_t now_us)
+        {
+            if (!has_output(now_us))
+            {
+                return false;
+            }
+            constexpr size_t budget = max_packet_size - wire::header_size - ack_header_size;
+
+            std::string payload(ack_header_size, '\0');
+            wire::detail::store<uint32_t>(payload.data(), remote_latest);
+            wire::detail::store<uint32_t>(payload.data() + 4, remote_bits);
+
+            SentPacket packet{next_packet, now_us, {}};
+            for (auto it = reliable_out.begin(); it != reliable_out.end();)
+            {
+                Outgoing& message = it->second;
+                if (!due(message, now_us))
+                {
+                    ++it;
+                    continue;
+                }
+                if (message.attempts >= max_attempts)
+                {
+                    stats.messages_abandoned++;
+                    it = reliable_out.erase(it);
+                    base_owed = true; // tell the peer to stop waiting for it
+                    continue;
+                }
+                if (payload.size() + message_header_size + message.data.size() > budget)
+                {
+                    break;
+                }
+                append(payload, Channel::Reliable, it->first, message.data);
+                stats.messages_resent += message.attempts > 0 ? 1 : 0;
+                message.attempts++;
+                message.last_sent = now_us;
+                packet.reliable.push_back(it->first);
+                ++it;
+            }
+            size_t taken = 0;
+            for (; taken < sequenced_out.size(); ++taken)
+            {
+                const auto& [sequence, data] = sequenced_out[taken];
+                if (payload.size() + message_header_size + data.size() > budget)
+                {
+                    break;
+                }
+                append(payload, Channel::Sequenced, sequence, data);
+            }
+            sequenced_out.erase(sequenced_out.begin(), sequenced_out.begin() + static_cast<std::ptrdiff_t>(taken));
+            if (payload.size() == ack_header_size && !ack_owed && !base_owed)
+            {
+                return false;
+            }
+            // After the loop, so it already accounts for messages abandoned above
+            wire::detail::store<uint32_t>(payload.data() + 8, reliable_out.empty() ? next_reliable : reliable_out.begin()->first);
+
+            out = wire::encode(wire::MessageType::ReliablePacket, local_id, next_packet++, now_us, payload.data(), payload.size());
+            ack_owed = false;
+            base_owed = false;
+            stats.packets_sent++;
+            sent.push_back(std::move(packet));
+            if (sent.size() > max_tracked_packets)
+            {
+                sent.pop_front();
+            }
+            return true;
+        }
+
+        // Processes a packet from the peer and calls on_message(Channel, const char*, size_t)
+        // for every message it makes deliverable. False if the frame is not a valid packet.
+        template <typename OnMessage>
+        bool receive(wire::MessageView packet, int64_t now_us, OnMessage&& on_message)
+        {
+            if (packet.type() != wire::MessageType::ReliablePacket || packet.payload_size() < ack_header_size)
+            {
+                return false;
+            }
+            stats.packets_received++;
+            acknowledged(wire::detail::load<uint32_t>(packet.payload()), wire::detail::load<uint32_t>(packet.payload() + 4), now_us);
+            skip_reliable(wire::detail::load<uint32_t>(packet.payload() + 8), on_message);
+
+            const char* p = packet.payload() + ack_header_size;
+            const char* end = packet.payload() + packet.payload_size();
+            bool stored = true;
+            while (end - p >= static_cast<std::ptrdiff_t>(message_header_size))
+            {
+                auto channel = static_cast<Channel>(static_cast<uint8_t>(p[0]));
+                uint32_t sequence = wire::detail::load<uint32_t>(p + 1);
+                size_t length = wire::detail::load<uint16_t>(p + 5);
+                p += message_header_size;
+                if (static_cast<size_t>(end - p) < length)
+                {
+                    return false;
+                }
+                if (channel == Channel::Reliable)
+                {
+                    stored &= deliver_reliable(sequence, p, length, on_message);
+                }
+                else if (!any_sequenced || sequence > latest_sequenced)
+                {
+                    any_sequenced = true;
+                    latest_sequenced = sequence;
+                    stats.messages_delivered++;
+                    on_message(Channel::Sequenced, p, length);
+                }
+                else
+                {
+                    stats.stale++;
+                }
+                p += length;
+            }
+            // A packet whose reliable messages did not all fit in 'held' is left unacknowledged,
+            // so the peer resends them. Acknowledgement-only packets are not acknowledged
+            // themselves, or two idle peers would keep answering each other.
+            if (stored)
+            {
+                record_received(packet.sequence(), packet.payload_size() > ack_header_size);
+            }
+            return true;
+        }
+
+        // Smoothed round trip time, packet sent to acknowledgement received
+        int64_t rtt_us() const
+        {
+            return srtt;
+        }
+
+        const Stats& statistics() const
+        {
+            return stats;
+        }
+
+    private:
+        struct Outgoing
+        {
+            std::string data;
+            int attempts = 0;
+            int64_t last_sent = 0;
+        };
+
+        struct SentPacket
+        {
+            uint32_t sequence;
+            int64_t sent_at;
+            std::vector<uint32_t> reliable;
+            bool acked = false;
+        };
+
+        // Acknowledgements only cover 32 packets back, so older packets' messages
+        // are left to the retransmission timeout
+        static constexpr size_t max_tracked_packets = 256;
+        // Out-of-order reliable messages held for a missing earlier one
+        static constexpr size_t max_held_messages = 1024;
+        static constexpr int64_t min_rto = 20000;
+        static constexpr int64_t max_rto = 1000000;
+        static constexpr int64_t initial_rto = 100000;
+
+        // The timeout doubles with every resend of the same message
+        bool due(const Outgoing& message, int64_t now_us) const
+        {
+            if (message.attempts == 0)
+            {
+                return true;
+            }
+            int64_t timeout = std::min(retransmission_timeout() << std::min(message.attempts - 1, 6), max_rto);
+            return now_us - message.last_sent >= timeout;
+        }
+
+        // RFC 6298 style: srtt + 4 * rttvar, clamped to [min_rto, max_rto]
+        int64_t retransmission_timeout() const
+        {
+            return srtt == 0 ? initial_rto : std::clamp(srtt + 4 * rttvar, min_rto, max_rto);
+        }
+
+        static void append(std::string& payload, Channel channel, uint32_t sequence, const std::string& data)
+        {
+            char header[message_header_size];
+            header[0] = static_cast<char>(channel);
+            wire::detail::store<uint32_t>(header + 1, sequence);
+            wire::detail::store<uint16_t>(header + 5, static_cast<uint16_t>(data.size()));
+            payload.append(header, message_header_size);
+            payload += data;
+        }
+
+        void record_received(uint32_t sequence, bool needs_ack)
+        {
+            ack_owed |= needs_ack;
+            if (sequence > remote_latest)
+            {
+                uint32_t shift = sequence - remote_latest;
+                uint32_t bits = shift >= 32 ? 0 : remote_bits << shift;
+                if (remote_latest != 0 && shift <= 32)
+                {
+                    bits |= 1u << (shift - 1);
+                }
+                remote_bits = bits;
+                remote_latest = sequence;
+            }
+            else if (sequence < remote_latest && remote_latest - sequence <= 32)
+            {
+                remote_bits |= 1u << (remote_latest - sequence - 1);
+            }
+        }
+
+        void acknowledged(uint32_t ack, uint32_t bits, int64_t now_us)
+        {
+            if (ack == 0)
+            {
+                return;
+            }
+            for (SentPacket& packet : sent)
+            {
+                if (packet.acked || packet.sequence > ack)
+                {
+                    continue;
+                }
+                uint32_t distance = ack - packet.sequence;
+                if (distance != 0 && (distance > 32 || !(bits & (1u << (distance - 1)))))
+                {
+                    continue;
+                }
+                packet.acked = true;
+                sample_rtt(now_us - packet.sent_at);
+                for (uint32_t sequence : packet.reliable)
+                {
+                    reliable_out.erase(sequence);
+                }
+            }
+        }
+
+        void sample_rtt(int64_t rtt)
+        {
+            if (srtt == 0)
+            {
+                srtt = std::max<int64_t>(rtt, 1);
+                rttvar = rtt / 2;
+                return;
+            }
+            rttvar = (3 * rttvar + std::abs(srtt - rtt)) / 4;
+            srtt = std::max<int64_t>((7 * srtt + rtt) / 8, 1);
+        }
+
+        // False if the message had to be dropped because 'held' is full
+        template <typename OnMessage>
+        bool deliver_reliable(uint32_t sequence, const char* data, size_t length, OnMessage& on_message)
+        {
+            if (sequence < expected_reliable || held.count(sequence) > 0)
+            {
+                return true; // a resend of something we already have
+            }
+            if (sequence > expected_reliable)
+            {
+                if (held.size() >= max_held_messages)
+                {
+                    return false;
+                }
+                held.emplace(sequence, std::string(data, length));
+                stats.out_of_order++;
+                return true;
+            }
+
+            expected_reliable++;
+            stats.messages_delivered++;
+            on_message(Channel::Reliable, data, length);
+            release_held(on_message);
+            return true;
+        }
+
+        // The peer will never send reliable messages before 'base' again: deliver the held
+        // ones before it in order, give up on the missing ones and continue from 'base'
+        template <typename OnMessage>
+        void skip_reliable(uint32_t base, OnMessage& on_message)
+        {
+            if (base <= expected_reliable)
+            {
+                return; // nothing missing, or a late packet with an older base
+            }
+            for (auto it = held.begin(); it != held.end() && it->first < base; it = held.erase(it))
+            {
+                stats.messages_skipped += it->first - expected_reliable;
+                expected_reliable = it->first + 1;
+                stats.messages_delivered++;
+                on_message(Channel::Reliable, it->second.data(), it->second.size());
+            }
+            if (base > expected_reliable)
+            {
+                stats.messages_skipped += base - expected_reliable;
+                expected_reliable = base;
+            }
+            release_held(on_message);
+        }
+
+        // Delivers the held messages that are next in order
+        template <typename OnMessage>
+        void release_held(OnMessage& on_message)
+        {
+            for (auto it = held.begin(); it != held.end() && it->first == expected_reliable; it = held.erase(it))
+            {
+                expected_reliable++;
+                stats.messages_delivered++;
+                on_message(Channel::Reliable, it->second.data(), it->second.size());
+            }
+        }
+
+        uint32_t local_id;
+        int max_attempts;
+        Stats stats;
+
+        // Sending side
+        uint32_t next_packet = 1;
+        uint32_t next_reliable = 0;
+        uint32_t next_sequenced = 0;
+        std::map<uint32_t, Outgoing> reliable_out; // unacknowledged, by channel sequence
+        std::vector<std::pair<uint32_t, std::string>> sequenced_out;
+        std::deque<SentPacket> sent;
+        bool base_owed = false; // a message was abandoned since the last packet
+        int64_t srtt = 0;
+        int64_t rttvar = 0;
+
+        // Receiving side
+        uint32_t remote_latest = 0;
+        uint32_t remote_bits = 0;
+        bool ack_owed = false;
+        uint32_t expected_reliable = 0;
+        std::map<uint32_t, std::string> held;
+        uint32_t latest_sequenced = 0;
+        bool any_sequenced = false;
+    };
+}
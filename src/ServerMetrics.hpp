@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include "CommandLine.hpp"
+#include "AsyncLog.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Server-side counters that replace the per-broadcast "Broadcast took" stdout line.
+//
+// Every thread records into its own cache-line-aligned slot. A slot has exactly one
+// writer, so recording is a relaxed load and store with no locked instruction and no
+// shared cache line. Readers sum all slots with relaxed loads; the totals may be a
+// few operations stale but never need a lock. A slot is claimed on a thread's first
+// record and released when the thread exits, and a later thread reuses it. All
+// counters are cumulative, so reuse keeps the totals correct. This matters for
+// servers that start a thread per client.
+namespace metrics
+{
+    // Fan-out durations are bucketed by power of two (bucket i holds 2^(i-1)..2^i-1 us)
+    constexpr size_t fanout_bucket_count = 32;
+
+    struct Totals
+    {
+        uint64_t messages_in = 0;
+        uint64_t bytes_in = 0;
+        uint64_t messages_out = 0;
+        uint64_t bytes_out = 0;
+        uint64_t send_errors = 0;
+        uint64_t dropped = 0;
+        uint64_t fanouts = 0;
+        uint64_t fanout_us = 0;
+        int64_t queue_depth = 0;
+        std::array<uint64_t, fanout_bucket_count> fanout_buckets{};
+
+        // Upper bound of the bucket that holds the given fan-out percentile
+        uint64_t fanout_percentile(double percentile) const
+        {
+            uint64_t target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(fanouts) + 0.5);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < fanout_bucket_count; ++i)
+            {
+                seen += fanout_buckets[i];
+                if (seen >= std::max<uint64_t>(target, 1))
+                {
+                    return bucket_upper_bound(i);
+                }
+            }
+            return 0;
+        }
+
+        static uint64_t bucket_upper_bound(size_t bucket)
+        {
+            return (uint64_t(1) << bucket) - 1;
+        }
+    };
+
+    namespace detail
+    {
+        struct alignas(64) Slot
+        {
+            std::atomic<bool> in_use{true};
+            Slot* next = nullptr;
+
+            std::atomic<uint64_t> messages_in{0};
+            std::atomic<uint64_t> bytes_in{0};
+            std::atomic<uint64_t> messages_out{0};
+            std::atomic<uint64_t> bytes_out{0};
+            std::atomic<uint64_t> send_errors{0};
+            std::atomic<uint64_t> dropped{0};
+            std::atomic<uint64_t> fanouts{0};
+            std::atomic<uint64_t> fanout_us{0};
+            std::atomic<int64_t> queue_depth{0};
+            std::array<std::atomic<uint64_t>, fanout_bucket_count> fanout_buckets{};
+        };
+
+        // Slots are never freed, so a reader can walk the list at any time
+        inline std::atomic<Slot*> slots{nullptr};
+
+        // Only the owning thread writes a slot, so no read-modify-write is needed
+        template <typename T>
+        inline void bump(std::atomic<T>& counter, T delta)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+
+        inline Slot* claim()
+        {
+            for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next)
+            {
+                bool expected = false;
+                if (slot->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    return slot;
+                }
+            }
+            Slot* slot = new Slot;
+            slot->next = slots.load(std::memory_order_relaxed);
+            while (!slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+            return slot;
+        }
+
+        struct SlotHandle
+        {
+            Slot* slot = claim();
+
+            ~SlotHandle()
+            {
+                slot->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        inline Slot& local()
+        {
+            thread_local SlotHandle handle;
+            return *handle.slot;
+        }
+    }
+
+    // One message read from a client
+    inline void received(size_t bytes)
+    {
+        detail::Slot& slot = detail::local();
+        detail::bump<uint64_t>(slot.messages_in, 1);
+        detail::bump<uint64_t>(slot.bytes_in, bytes);
+    }
+
+    // 'messages' sends (datagrams, or messages in one gathered write) totalling 'bytes'
+    inline void sent(size_t bytes, size_t messages = 1)
+    {
+        detail::Slot& slot = detail::local();
+        detail::bump<uint64_t>(slot.messages_out, messages);
+        detail::bump<uint64_t>(slot.bytes_out, bytes);
+    }
+
+    inline void send_error(size_t count = 1)
+    {
+        detail::bump<uint64_t>(detail::local().send_errors, count);
+    }
+
+    // Messages a server gave up on because an internal queue was full, e.g. a shard ring
+    inline void dropped(size_t count = 1)
+    {
+        detail::bump<uint64_t>(detail::local().dropped, count);
+    }
+
+    // One fan-out pass (a message, a receive batch or a tick) to every recipient took 'duration'
+    inline void fanout(std::chrono::nanoseconds duration)
+    {
+        uint64_t us = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0));
+        size_t bucket = std::min<size_t>(static_cast<size_t>(std::bit_width(us)), fanout_bucket_count - 1);
+        detail::Slot& slot = detail::local();
+        detail::bump<uint64_t>(slot.fanouts, 1);
+        detail::bump<uint64_t>(slot.fanout_us, us);
+        detail::bump<uint64_t>(slot.fanout_buckets[bucket], 1);
+    }
+
+    // Messages waiting in outbound queues; enqueue and dequeue may happen on different
+    // threads, the per-slot values only add up to the true depth in the total.
+    inline void queued(int64_t delta)
+    {
+        detail::bump<int64_t>(detail::local().queue_depth, delta);
+    }
+
+    inline Totals collect()
+    {
+        Totals totals;
+        for (detail::Slot* slot = detail::slots.load(std::memory_order_acquire); slot; slot = slot->next)
+        {
+            totals.messages_in += slot->messages_in.load(std::memory_order_relaxed);
+            totals.bytes_in += slot->bytes_in.load(std::memory_order_relaxed);
+            totals.messages_out += slot->messages_out.load(std::memory_order_relaxed);
+            totals.bytes_out += slot->bytes_out.load(std::memory_order_relaxed);
+            totals.send_errors += slot->send_errors.load(std::memory_order_relaxed);
+            totals.dropped += slot->dropped.load(std::memory_order_relaxed);
+            totals.fanouts += slot->fanouts.load(std::memory_order_relaxed);
+            totals.fanout_us += slot->fanout_us.load(std::memory_order_relaxed);
+            totals.queue_depth += slot->queue_depth.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < fanout_bucket_count; ++i)
+            {
+                totals.fanout_buckets[i] += slot->fanout_buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+    // Activity between two collect() calls; the queue depth stays the current one
+    inline Totals difference(const Totals& now, const Totals& before)
+    {
+        Totals delta = now;
+        delta.messages_in -= before.messages_in;
+        delta.bytes_in -= before.bytes_in;
+        delta.messages_out -= before.messages_out;
+        delta.bytes_out -= before.bytes_out;
+        delta.send_errors -= before.send_errors;
+        delta.dropped -= before.dropped;
+        delta.fanouts -= before.fanouts;
+        delta.fanout_us -= before.fanout_us;
+        for (size_t i = 0; i < fanout_bucket_count; ++i)
+        {
+            delta.fanout_buckets[i] -= before.fanout_buckets[i];
+        }
+        return delta;
+    }
+
+    // e.g. "Stats: in 1000 msg/s (23.4 KB/s), out 1000000 msg/s (22.9 MB/s), fan-out 1000/s p50 <= 63us p99 <= 255us, queued 0, send errors 0, dropped 0"
+    // Written straight to the stream rather than through the logger, so --stats-interval
+    // works whatever BROADCAST_LOG_LEVEL the server was built with
+    inline void print_stats(std::ostream& out, const Totals& delta, double seconds)
+    {
+        auto rate = [&](uint64_t value) { return static_cast<uint64_t>(static_cast<double>(value) / seconds + 0.5); };
+        auto bytes = [&](uint64_t value)
+        {
+            std::ostringstream text;
+            double per_second = static_cast<double>(value) / seconds;
+            text << std::fixed << std::setprecision(1);
+            if (per_second >= 1024 * 1024) text << per_second / (1024 * 1024) << " MB/s";
+            else if (per_second >= 1024) text << per_second / 1024 << " KB/s";
+            else text << per_second << " B/s";
+            return text.str();
+        };
+
+        std::ostringstream line;
+        line << "Stats: in " << rate(delta.messages_in) << " msg/s (" << bytes(delta.bytes_in) << ")"
+             << ", out " << rate(delta.messages_out) << " msg/s (" << bytes(delta.bytes_out) << ")"
+             << ", fan-out " << rate(delta.fanouts) << "/s";
+        // No fan-out in this interval, so there is no duration to report
+        if (delta.fanouts > 0)
+        {
+            line << " p50 <= " << delta.fanout_percentile(50) << "us p99 <= " << delta.fanout_percentile(99) << "us";
+        }
+        line << ", queued " << delta.queue_depth << ", send errors " << delta.send_errors << ", dropped " << delta.dropped;
+        out << line.str() << std::endl;
+    }
+
+    // Prometheus text exposition format (version 0.0.4)
+    inline std::string prometheus_text(const Totals& totals, const std::string& server)
+    {
+        std::ostringstream out;
+        std::string label = "{server=\"" + server + "\"}";
+        auto metric = [&](const char* name, const char* type, const char* help, auto value)
+        {
+            out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n" << name << label << " " << value << "\n";
+        };
+        metric("broadcast_messages_received_total", "counter", "Messages received from clients.", totals.messages_in);
+        metric("broadcast_bytes_received_total", "counter", "Payload bytes received from clients.", totals.bytes_in);
+        metric("broadcast_messages_sent_total", "counter", "Messages sent to clients.", totals.messages_out);
+        metric("broadcast_bytes_sent_total", "counter", "Payload bytes sent to clients.", totals.bytes_out);
+        metric("broadcast_send_errors_total", "counter", "Failed sends.", totals.send_errors);
+        metric("broadcast_messages_dropped_total", "counter", "Messages dropped because an internal queue was full.", totals.dropped);
+        metric("broadcast_queue_depth", "gauge", "Messages waiting in outbound queues.", totals.queue_depth);
+
+        const char* name = "broadcast_fanout_duration_microseconds";
+        out << "# HELP " << name << " Time to hand one message to every recipient.\n# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i + 1 < fanout_bucket_count; ++i)
+        {
+            cumulative += totals.fanout_buckets[i];
+            out << name << "_bucket{server=\"" << server << "\",le=\"" << Totals::bucket_upper_bound(i) << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{server=\"" << server << "\",le=\"+Inf\"} " << totals.fanouts << "\n";
+        out << name << "_sum" << label << " " << totals.fanout_us << "\n";
+        out << name << "_count" << label << " " << totals.fanouts << "\n";
+        return out.str();
+    }
+
+    namespace detail
+    {
+        // A client that sends no complete request in time is dropped, so it cannot stall the endpoint
+        constexpr auto request_timeout = std::chrono::seconds(2);
+
+        // Answers every connection with the current metrics, whatever the request path.
+        // One connection at a time on the caller's thread, driven by 'ctx' for the deadline.
+        template <typename Protocol>
+        void serve(boost::asio::io_context& ctx, typename Protocol::acceptor& acceptor, const std::string& server)
+        {
+            while (true)
+            {
+                typename Protocol::socket socket(ctx);
+                boost::system::error_code ec;
+                acceptor.accept(socket, ec);
+                if (ec)
+                {
+                    // e.g. out of file descriptors: back off and keep serving
+                    LOG_WARN("Metrics endpoint accept error: {}", ec.message());
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+
+                boost::asio::streambuf request;
+                std::string response;
+                bool answered = false;
+                try
+                {
+                    boost::asio::async_read_until(socket, request, "\r\n\r\n", [&](const boost::system::error_code& read_ec, size_t)
+                    {
+                        if (read_ec == boost::asio::error::operation_aborted)
+                        {
+                            return;
+                        }
+                        std::string body = prometheus_text(collect(), server);
+                        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                            + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+                        boost::asio::async_write(socket, boost::asio::buffer(response), [&](const boost::system::error_code&, size_t)
+                        {
+                            answered = true;
+                        });
+                    });
+                    ctx.restart();
+                    ctx.run_for(request_timeout);
+                    if (!answered)
+                    {
+                        LOG_WARN("Metrics request timed out");
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    LOG_WARN("Metrics request error: {}", e.what());
+                }
+                // Whatever is still pending completes with operation_aborted before its buffers go away
+                socket.close(ec);
+                ctx.restart();
+                ctx.run();
+            }
+        }
+    }
+
+    inline void print_usage(std::ostream& out)
+    {
+        out << "  --stats-interval=S     print a stats line every S seconds (default 1, 0 = off)" << std::endl;
+        out << "  --metrics-port=P       serve Prometheus metrics over HTTP on 127.0.0.1:P" << std::endl;
+        out << "  --metrics-socket=PATH  serve Prometheus metrics over HTTP on a Unix socket" << std::endl;
+    }
+
+    // Starts the reporting threads requested on the command line. They run detached
+    // for the life of the process and never touch the hot path.
+    inline void start_reporting(const CommandLine& args, const std::string& server)
+    {
+        double interval = args.getDouble("stats-interval", 1);
+        if (interval > 0)
+        {
+            std::thread([interval]
+            {
+                auto period = std::chrono::duration<double>(interval);
+                Totals before = collect();
+                auto last = std::chrono::steady_clock::now();
+                while (true)
+                {
+                    std::this_thread::sleep_for(period);
+                    Totals now = collect();
+                    auto time = std::chrono::steady_clock::now();
+                    Totals delta = difference(now, before);
+                    // Stay quiet while idle
+                    if (delta.messages_in || delta.messages_out || delta.send_errors || delta.dropped || delta.queue_depth)
+                    {
+                        print_stats(std::cout, delta, std::chrono::duration<double>(time - last).count());
+                    }
+                    before = now;
+                    last = time;
+                }
+            }).detach();
+        }
+
+        long long port = args.getInt("metrics-port", 0);
+        if (port > 0)
+        {
+            std::thread([port, server]
+            {
+                try
+                {
+                    boost::asio::io_context ctx;
+                    boost::asio::ip::tcp::acceptor acceptor(ctx, {boost::asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(port)});
+                    detail::serve<boost::asio::ip::tcp>(ctx, acceptor, server);
+                }
+                catch (const std::exception& e)
+                {
+                    LOG_ERROR("Metrics endpoint error: {}", e.what());
+                }
+            }).detach();
+            std::cout << "Metrics at http://127.0.0.1:" << port << "/metrics" << std::endl;
+        }
+
+        std::string path = args.get("metrics-socket");
+        if (!path.empty())
+        {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+            std::thread([path, server]
+            {
+                try
+                {
+                    boost::asio::io_context ctx;
+                    ::unlink(path.c_str()); // left behind by a previous run
+                    boost::asio::local::stream_protocol::acceptor acceptor(ctx, boost::asio::local::stream_protocol::endpoint(path));
+                    detail::serve<boost::asio::local::stream_protocol>(ctx, acceptor, server);
+                }
+                catch (const std::exception& e)
+                {
+                    LOG_ERROR("Metrics endpoint error: {}", e.what());
+                }
+            }).detach();
+            std::cout << "Metrics on Unix socket " << path << std::endl;
+#else
+            std::cerr << "--metrics-socket is not supported on this platform" << std::endl;
+#endif
+        }
+    }
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio/ip/udp.hpp>
+#include "WireProtocol.hpp"
+
+// Client sessions for the UDP servers (--sessions). A Connect handshake gives every
+// client a compact id that it stamps into the session field of each frame it sends, so
+// a datagram finds its client with one array index and one comparison instead of an
+// ordered lookup by endpoint. Sessions that stay silent for the idle timeout are
+// evicted by a timer wheel, so the fan-out lists only hold clients that are still there.
+//
+// touch() is lock-free and may be called from any number of receiving threads. open()
+// and expire() serialize on a mutex; both are rare compared to touch().
+//
+// The wheel has one bucket per tick, enough to cover the timeout, and each session sits
+// in exactly one bucket: the one of the tick it would expire at if it stayed silent.
+// touch() only records the current tick. When the wheel reaches a bucket, sessions that
+// were active in the meantime move on to the bucket of their new deadline and the rest
+// are evicted, so both marking activity and expiring are O(1) per session.
+class SessionTable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Endpoint = boost::asio::ip::udp::endpoint;
+
+    // Session ids travel in the 16-bit session field, 0 = no session
+    static constexpr size_t max_capacity = 65535;
+    // Ticks per idle timeout: how late after the timeout a session may be evicted
+    static constexpr int64_t wheel_resolution = 32;
+
+    // An idle_timeout of zero never evicts
+    SessionTable(size_t capacity, Clock::duration idle_timeout)
+        : capacity(std::clamp<size_t>(capacity, 1, max_capacity)),
+          slots(std::make_unique<Slot[]>(this->capacity + 1)),
+          start(Clock::now())
+    {
+        for (size_t id = this->capacity; id > 0; --id)
+        {
+            free_ids.push_back(static_cast<uint16_t>(id));
+        }
+        if (idle_timeout > Clock::duration::zero())
+        {
+            tick = std::max<Clock::duration>(idle_timeout / wheel_resolution, std::chrono::milliseconds(1));
+            timeout_ticks = static_cast<uint64_t>((idle_timeout + tick - Clock::duration(1)) / tick);
+            wheel.resize(timeout_ticks + 1);
+        }
+    }
+
+    // Handshake: the endpoint's session, opened if it has none yet ('opened' tells which).
+    // 'client' is the sender id of the Connect frame. Returns 0 if the table is full.
+    uint16_t open(const Endpoint& endpoint, uint32_t client, bool& opened)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        opened = false;
+        auto existing = by_endpoint.find(endpoint);
+        if (existing != by_endpoint.end())
+        {
+            // A repeated Connect, e.g. because the Accept was lost
+            slots[existing->second].last_active.store(current_tick.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return existing->second;
+        }
+        if (free_ids.empty())
+        {
+            return 0;
+        }
+
+        uint16_t id = free_ids.back();
+        free_ids.pop_back();
+        Slot& slot = slots[id];
+        slot.endpoint = endpoint;
+        slot.client = client;
+        uint64_t now = current_tick.load(std::memory_order_relaxed);
+        slot.last_active.store(now, std::memory_order_relaxed);
+        slot.key.store(key_of(endpoint), std::memory_order_release);
+        by_endpoint.emplace(endpoint, id);
+        if (!wheel.empty())
+        {
+            wheel[(now + timeout_ticks) % wheel.size()].push_back(id);
+        }
+        opened = true;
+        return id;
+    }
+
+    // Server side of the protocol for one datagram. True if it belongs to an open session and
+    // should be handled as usual. Otherwise it is either a Connect, which opens a session
+    // ('opened' is set for a new one), or it names no session of this endpoint; either way
+    // 'reply' is the Accept frame to send back, with the session id or 0 = connect again.
+    bool admit(const Endpoint& endpoint, const char* data, size_t size, std::string& reply, bool& opened)
+    {
+        reply.clear();
+        opened = false;
+        uint16_t session = 0;
+        if (size >= wire::header_size)
+        {
+            wire::MessageView frame(data);
+            if (frame.type() == wire::MessageType::Connect)
+            {
+                uint16_t id = open(endpoint, frame.sender(), opened);
+                reply = wire::encode(wire::MessageType::Accept, frame.sender(), 0, frame.timestamp());
+                wire::set_session(reply.data(), id);
+                return false;
+            }
+            session = frame.session();
+        }
+        if (touch(session, endpoint))
+        {
+            return true;
+        }
+        reply = wire::encode(wire::MessageType::Accept, 0, 0, 0);
+        return false;
+    }
+
+    // Whether 'session' is open and belongs to 'endpoint'. Marks it active if so.
+    bool touch(uint16_t session, const Endpoint& endpoint)
+    {
+        if (!is_open(session, endpoint))
+        {
+            return false;
+        }
+        slots[session].last_active.store(current_tick.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return true;
+    }
+
+    // Like touch(), without marking the session active. expire() closes a session before
+    // it calls on_evict, so a caller that added per-client state and then finds its session
+    // closed knows the eviction may have missed that state.
+    bool is_open(uint16_t session, const Endpoint& endpoint) const
+    {
+        if (session == 0 || session > capacity)
+        {
+            return false;
+        }
+        return slots[session].key.load(std::memory_order_acquire) == key_of(endpoint);
+    }
+
+    // Advances the wheel to 'now' and closes every session that was silent for the idle
+    // timeout, calling on_evict(const Endpoint&, uint32_t client) for each under the mutex
+    template <typename OnEvict>
+    void expire(Clock::time_point now, OnEvict&& on_evict)
+    {
+        if (wheel.empty())
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t target = static_cast<uint64_t>((now - start) / tick);
+        for (uint64_t current = current_tick.load(std::memory_order_relaxed); current < target;)
+        {
+            current++;
+            current_tick.store(current, std::memory_order_relaxed);
+
+            // A session that stays has its deadline after 'current' and within the wheel,
+            // so it never lands back in the bucket being drained
+            auto& bucket = wheel[current % wheel.size()];
+            for (uint16_t id : bucket)
+            {
+                Slot& slot = slots[id];
+                uint64_t last_active = slot.last_active.load(std::memory_order_relaxed);
+                if (current - std::min(last_active, current) < timeout_ticks)
+                {
+                    wheel[(last_active + timeout_ticks) % wheel.size()].push_back(id);
+                    continue;
+                }
+                slot.key.store(0, std::memory_order_release);
+                by_endpoint.erase(slot.endpoint);
+                free_ids.push_back(id);
+                on_evict(slot.endpoint, slot.client);
+            }
+            bucket.clear();
+        }
+    }
+
+    // How often expire() should run
+    Clock::duration tick_length() const
+    {
+        return tick;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return by_endpoint.size();
+    }
+
+private:
+    struct Slot
+    {
+        // key_of(endpoint) while open, 0 while free; the only field touch() compares
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> last_active{0};
+        Endpoint endpoint;
+        uint32_t client = 0;
+    };
+
+    // IPv4 endpoints map to distinct non-zero keys. IPv6 ones are hashed, so a forged
+    // session id only passes if its hash collides with the owner's.
+    static uint64_t key_of(const Endpoint& endpoint)
+    {
+        if (endpoint.address().is_v4())
+        {
+            return (uint64_t{1} << 48) | (uint64_t{endpoint.address().to_v4().to_uint()} << 16) | endpoint.port();
+        }
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char byte : endpoint.address().to_v6().to_bytes())
+        {
+            hash = (hash ^ byte) * 1099511628211ull;
+        }
+        return (hash ^ endpoint.port()) | (uint64_t{1} << 63);
+    }
+
+    size_t capacity;
+    std::unique_ptr<Slot[]> slots; // indexed by session id, slot 0 unused
+    Clock::time_point start;
+    std::atomic<uint64_t> current_tick{0};
+
+    mutable std::mutex mutex;
+    std::vector<uint16_t> free_ids; // lowest id at the back
+    std::map<Endpoint, uint16_t> by_endpoint;
+    Clock::duration tick = Clock::duration::zero();
+    uint64_t timeout_ticks = 0;
+    std::vector<std::vector<uint16_t>> wheel;
+};
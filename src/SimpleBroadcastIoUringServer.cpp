@@ -0,0 +1,782 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <boost/asio.hpp>
+#include <liburing.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "CommandLine.hpp"
+#include "WireProtocol.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+// Single-threaded broadcast server driven entirely by io_uring.
+// TCP mode is wire compatible with TCPSimpleBroadcastLoadTest, UDP mode with UDPSimpleBroadcastLoadTest.
+//
+// * Accepted sockets live in the fixed file table (multishot accept_direct), so
+//   recv/write never look up a file descriptor.
+// * Receives use a provided buffer ring and multishot recv/recvmsg, falling back
+//   to re-armed single-shot requests on kernels that reject multishot.
+// * Outgoing TCP payloads are copied once into a registered slab and written with
+//   write_fixed. A broadcast queues one SQE per idle recipient and submits them all
+//   with a single io_uring_enter.
+
+namespace
+{
+    constexpr unsigned ring_entries = 4096;
+    constexpr unsigned max_connections = 4096;
+
+    constexpr int recv_buffer_group = 0;
+    constexpr unsigned recv_buffer_count = 1024; // must be a power of two
+    constexpr size_t recv_buffer_size = 4096;
+
+    constexpr unsigned send_slot_count = 4096;
+    constexpr size_t send_slot_size = 1024;
+
+    // user_data layout: operation in the top byte, object pointer in the rest
+    enum class Op : uint64_t { Accept = 1, Recv, Write, Shutdown, Close, UdpRecv, UdpSend };
+
+    uint64_t encode(Op op, const void* ptr = nullptr)
+    {
+        return (static_cast<uint64_t>(op) << 56) | reinterpret_cast<uintptr_t>(ptr);
+    }
+
+    Op decodeOp(uint64_t data)
+    {
+        return static_cast<Op>(data >> 56);
+    }
+
+    template <typename T>
+    T* decodePtr(uint64_t data)
+    {
+        return reinterpret_cast<T*>(data & ((uint64_t(1) << 56) - 1));
+    }
+}
+
+// One broadcast payload shared by every recipient queue. Small payloads live in a
+// slot of the registered slab (written with write_fixed), larger ones on the heap.
+struct Message
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    int slot = -1;
+    std::string heap;
+};
+
+struct Connection
+{
+    int file = -1;          // index in the fixed file table
+    bool closing = false;
+    int pending = 0;        // submitted requests that will still produce a final CQE
+    size_t active_index = 0;
+    std::string inbound;
+    std::deque<std::shared_ptr<Message>> outbound;
+    size_t written = 0;     // bytes of outbound.front() already sent
+    bool writing = false;
+};
+
+// Keeps the msghdrs of one UDP fan-out alive until every sendmsg completed
+struct UdpBroadcast
+{
+    std::string payload;
+    iovec iov{};
+    std::vector<msghdr> headers;
+    size_t pending = 0;
+};
+
+class IoUringServer
+{
+public:
+    IoUringServer(bool udp_mode, bool binary_mode)
+        : udp_mode(udp_mode),
+          binary_mode(binary_mode),
+          recv_buffers(recv_buffer_count * recv_buffer_size),
+          send_slab(send_slot_count * send_slot_size)
+    {
+        io_uring_params params{};
+        int ret = io_uring_queue_init_params(ring_entries, &ring, &params);
+        if (ret < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_queue_init failed: ") + std::strerror(-ret));
+        }
+
+        buf_ring = io_uring_setup_buf_ring(&ring, recv_buffer_count, recv_buffer_group, 0, &ret);
+        if (!buf_ring)
+        {
+            throw std::runtime_error(std::string("provided buffer ring not supported: ") + std::strerror(-ret));
+        }
+        for (unsigned i = 0; i < recv_buffer_count; ++i)
+        {
+            io_uring_buf_ring_add(buf_ring, recv_buffers.data() + i * recv_buffer_size, recv_buffer_size, static_cast<unsigned short>(i),
+                                  io_uring_buf_ring_mask(recv_buffer_count), static_cast<int>(i));
+        }
+        io_uring_buf_ring_advance(buf_ring, recv_buffer_count);
+
+        iovec slab{ send_slab.data(), send_slab.size() };
+        ret = io_uring_register_buffers(&ring, &slab, 1);
+        if (ret < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_register_buffers failed: ") + std::strerror(-ret));
+        }
+        for (unsigned i = send_slot_count; i > 0; --i)
+        {
+            free_slots.push_back(static_cast<int>(i - 1));
+        }
+    }
+
+    ~IoUringServer()
+    {
+        io_uring_free_buf_ring(&ring, buf_ring, recv_buffer_count, recv_buffer_group);
+        io_uring_queue_exit(&ring);
+    }
+
+    void run(unsigned short port)
+    {
+        if (udp_mode)
+        {
+            startUdp(port);
+        }
+        else
+        {
+            startTcp(port);
+        }
+
+        while (true)
+        {
+            int ret = io_uring_submit_and_wait(&ring, 1);
+            // -EBUSY/-EAGAIN: the kernel takes no more submissions until completions are reaped
+            if (ret < 0 && ret != -EINTR && ret != -EBUSY && ret != -EAGAIN)
+            {
+                throw std::runtime_error(std::string("io_uring_submit_and_wait failed: ") + std::strerror(-ret));
+            }
+            handleCompletions();
+        }
+    }
+
+private:
+    // Flushes the submission queue to the kernel when it is full. If the kernel wants
+    // completions reaped first, they are moved to the deferred queue, never handled here:
+    // callers may be iterating connections or clients that a handler would change.
+    io_uring_sqe* getSqe()
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        while (!sqe)
+        {
+            if (!submit())
+            {
+                deferCompletions();
+            }
+            sqe = io_uring_get_sqe(&ring);
+        }
+        return sqe;
+    }
+
+    // False if the kernel refused the submissions until completions are reaped (-EBUSY,
+    // -EAGAIN); they stay queued for the next submit
+    bool submit()
+    {
+        int ret = io_uring_submit(&ring);
+        if (ret == -EBUSY || ret == -EAGAIN)
+        {
+            return false;
+        }
+        if (ret < 0 && ret != -EINTR)
+        {
+            throw std::runtime_error(std::string("io_uring_submit failed: ") + std::strerror(-ret));
+        }
+        return true;
+    }
+
+    // Copies every available completion to the deferred queue and frees its CQ entry
+    void deferCompletions()
+    {
+        io_uring_cqe* cqe;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0)
+        {
+            deferred.push_back(*cqe);
+            io_uring_cqe_seen(&ring, cqe);
+        }
+    }
+
+    // Only called from run(). Every completion goes through the deferred queue, so ones
+    // getSqe() deferred while a handler ran are still handled in order.
+    void handleCompletions()
+    {
+        deferCompletions();
+        while (!deferred.empty())
+        {
+            io_uring_cqe completion = deferred.front();
+            deferred.pop_front();
+            handle(&completion);
+            if (deferred.empty())
+            {
+                deferCompletions();
+            }
+        }
+    }
+
+    void handle(io_uring_cqe* cqe)
+    {
+        uint64_t data = io_uring_cqe_get_data64(cqe);
+        switch (decodeOp(data))
+        {
+        case Op::Accept:
+            onAccept(cqe);
+            break;
+        case Op::Recv:
+            onRecv(decodePtr<Connection>(data), cqe);
+            break;
+        case Op::Write:
+            onWrite(decodePtr<Connection>(data), cqe);
+            break;
+        case Op::Shutdown:
+        case Op::Close:
+        {
+            auto* conn = decodePtr<Connection>(data);
+            conn->pending--;
+            release(conn);
+            break;
+        }
+        case Op::UdpRecv:
+            onUdpRecv(cqe);
+            break;
+        case Op::UdpSend:
+        {
+            auto* broadcast = decodePtr<UdpBroadcast>(data);
+            metrics::queued(-1);
+            if (cqe->res < 0)
+            {
+                metrics::send_error();
+            }
+            else
+            {
+                metrics::sent(static_cast<size_t>(cqe->res));
+            }
+            if (--broadcast->pending == 0)
+            {
+                delete broadcast;
+            }
+            break;
+        }
+        }
+    }
+
+    void recycleBuffer(io_uring_cqe* cqe)
+    {
+        if (!(cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            return;
+        }
+        unsigned short bid = static_cast<unsigned short>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        io_uring_buf_ring_add(buf_ring, recv_buffers.data() + bid * recv_buffer_size, recv_buffer_size, bid,
+                              io_uring_buf_ring_mask(recv_buffer_count), 0);
+        io_uring_buf_ring_advance(buf_ring, 1);
+    }
+
+    const char* bufferOf(io_uring_cqe* cqe)
+    {
+        unsigned short bid = static_cast<unsigned short>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        return recv_buffers.data() + bid * recv_buffer_size;
+    }
+
+    // ---- TCP ---------------------------------------------------------------
+
+    void startTcp(unsigned short port)
+    {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd, SOMAXCONN) < 0)
+        {
+            throw std::runtime_error(std::string("bind/listen failed: ") + std::strerror(errno));
+        }
+
+        int ret = io_uring_register_files_sparse(&ring, max_connections);
+        if (ret < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_register_files_sparse failed: ") + std::strerror(-ret));
+        }
+
+        std::cout << "Server listening on port " << port << " (TCP, io_uring)..." << std::endl;
+        armAccept();
+    }
+
+    void armAccept()
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (multishot_accept)
+        {
+            io_uring_prep_multishot_accept_direct(sqe, listen_fd, nullptr, nullptr, 0);
+        }
+        else
+        {
+            io_uring_prep_accept_direct(sqe, listen_fd, nullptr, nullptr, 0, IORING_FILE_INDEX_ALLOC);
+        }
+        io_uring_sqe_set_data64(sqe, encode(Op::Accept));
+    }
+
+    void onAccept(io_uring_cqe* cqe)
+    {
+        if (cqe->res >= 0)
+        {
+            auto* conn = new Connection();
+            conn->file = cqe->res;
+            conn->active_index = active.size();
+            active.push_back(conn);
+            LOG_INFO("Client connected (fixed file {})", conn->file);
+            armRecv(conn);
+        }
+        else if (cqe->res == -EINVAL && multishot_accept)
+        {
+            LOG_INFO("Multishot accept not supported, falling back to single-shot");
+            multishot_accept = false;
+        }
+        else
+        {
+            LOG_WARN("Accept error: {}", std::strerror(-cqe->res));
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+            armAccept();
+        }
+    }
+
+    void armRecv(Connection* conn)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (multishot_recv)
+        {
+            io_uring_prep_recv_multishot(sqe, conn->file, nullptr, 0, 0);
+        }
+        else
+        {
+            io_uring_prep_recv(sqe, conn->file, nullptr, 0, 0);
+        }
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+        sqe->buf_group = recv_buffer_group;
+        io_uring_sqe_set_data64(sqe, encode(Op::Recv, conn));
+        conn->pending++;
+    }
+
+    void onRecv(Connection* conn, io_uring_cqe* cqe)
+    {
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if (!more)
+        {
+            conn->pending--;
+        }
+
+        if (cqe->res > 0)
+        {
+            conn->inbound.append(bufferOf(cqe), static_cast<size_t>(cqe->res));
+            recycleBuffer(cqe);
+            if (!conn->closing && binary_mode)
+            {
+                processFrames(conn);
+            }
+            else if (!conn->closing)
+            {
+                processLines(conn);
+            }
+        }
+        else if (cqe->res == -EINVAL && multishot_recv)
+        {
+            LOG_INFO("Multishot recv not supported, falling back to single-shot");
+            multishot_recv = false;
+        }
+        else if (cqe->res != -ENOBUFS)
+        {
+            // 0 is an orderly shutdown, anything else a socket error
+            if (cqe->res < 0 && !conn->closing)
+            {
+                LOG_WARN("Session error: {}", std::strerror(-cqe->res));
+            }
+            closeConnection(conn);
+        }
+
+        if (!more && !conn->closing)
+        {
+            armRecv(conn);
+        }
+        release(conn);
+    }
+
+    // line-by-line framing, like the Asio servers' read_until('\n')
+    void processLines(Connection* conn)
+    {
+        size_t begin = 0;
+        size_t newline;
+        while ((newline = conn->inbound.find('\n', begin)) != std::string::npos)
+        {
+            broadcast(conn->inbound.data() + begin, newline + 1 - begin);
+            begin = newline + 1;
+        }
+        conn->inbound.erase(0, begin);
+    }
+
+    // length-prefixed wire frames, forwarded verbatim
+    void processFrames(Connection* conn)
+    {
+        try
+        {
+            size_t consumed = wire::for_each_frame(conn->inbound.data(), conn->inbound.size(), [this](wire::MessageView frame)
+            {
+                broadcast(frame.data(), frame.length());
+            });
+            conn->inbound.erase(0, consumed);
+        }
+        catch (std::exception& e)
+        {
+            LOG_WARN("Session error: {}", e.what());
+            closeConnection(conn);
+        }
+    }
+
+    std::shared_ptr<Message> makeMessage(const char* data, size_t size)
+    {
+        auto* msg = new Message();
+        if (size <= send_slot_size && !free_slots.empty())
+        {
+            msg->slot = free_slots.back();
+            free_slots.pop_back();
+            char* dst = send_slab.data() + msg->slot * send_slot_size;
+            std::memcpy(dst, data, size);
+            msg->data = dst;
+        }
+        else
+        {
+            msg->heap.assign(data, size);
+            msg->data = msg->heap.data();
+        }
+        msg->size = size;
+
+        return std::shared_ptr<Message>(msg, [this](Message* m)
+        {
+            if (m->slot >= 0)
+            {
+                free_slots.push_back(m->slot);
+            }
+            delete m;
+        });
+    }
+
+    void broadcast(const char* data, size_t size)
+    {
+        metrics::received(size);
+        auto msg = makeMessage(data, size);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (Connection* conn : active)
+        {
+            conn->outbound.push_back(msg);
+            metrics::queued(1);
+            if (!conn->writing)
+            {
+                submitWrite(conn);
+            }
+        }
+        // every recipient's write goes to the kernel in one io_uring_enter
+        submit();
+        auto end = std::chrono::high_resolution_clock::now();
+        metrics::fanout(end - start);
+    }
+
+    void submitWrite(Connection* conn)
+    {
+        const Message& msg = *conn->outbound.front();
+        io_uring_sqe* sqe = getSqe();
+        if (msg.slot >= 0)
+        {
+            io_uring_prep_write_fixed(sqe, conn->file, msg.data + conn->written, static_cast<unsigned>(msg.size - conn->written), 0, 0);
+        }
+        else
+        {
+            io_uring_prep_send(sqe, conn->file, msg.data + conn->written, msg.size - conn->written, MSG_NOSIGNAL);
+        }
+        sqe->flags |= IOSQE_FIXED_FILE;
+        io_uring_sqe_set_data64(sqe, encode(Op::Write, conn));
+        conn->writing = true;
+        conn->pending++;
+    }
+
+    void onWrite(Connection* conn, io_uring_cqe* cqe)
+    {
+        conn->pending--;
+        conn->writing = false;
+        if (cqe->res < 0)
+        {
+            if (!conn->closing)
+            {
+                LOG_WARN("Write error: {}", std::strerror(-cqe->res));
+                metrics::send_error();
+            }
+            closeConnection(conn);
+        }
+        else if (!conn->closing)
+        {
+            conn->written += static_cast<size_t>(cqe->res);
+            if (conn->written == conn->outbound.front()->size)
+            {
+                metrics::sent(conn->written);
+                metrics::queued(-1);
+                conn->outbound.pop_front();
+                conn->written = 0;
+            }
+            if (!conn->outbound.empty())
+            {
+                submitWrite(conn);
+            }
+        }
+        release(conn);
+    }
+
+    // Shutting the socket down terminates the armed multishot recv and any pending write,
+    // the linked close then frees the fixed file slot for the next accept.
+    void closeConnection(Connection* conn)
+    {
+        if (conn->closing)
+        {
+            return;
+        }
+        conn->closing = true;
+
+        Connection* last = active.back();
+        active[conn->active_index] = last;
+        last->active_index = conn->active_index;
+        active.pop_back();
+
+        io_uring_sqe* sqe = getSqe();
+        io_uring_prep_shutdown(sqe, conn->file, SHUT_RDWR);
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        io_uring_sqe_set_data64(sqe, encode(Op::Shutdown, conn));
+        conn->pending++;
+
+        sqe = getSqe();
+        io_uring_prep_close_direct(sqe, static_cast<unsigned>(conn->file));
+        io_uring_sqe_set_data64(sqe, encode(Op::Close, conn));
+        conn->pending++;
+
+        LOG_INFO("Client disconnected");
+    }
+
+    // Called after every CQE of a connection; frees it once closed and fully drained
+    void release(Connection* conn)
+    {
+        if (conn->closing && conn->pending == 0)
+        {
+            metrics::queued(-static_cast<int64_t>(conn->outbound.size()));
+            delete conn;
+        }
+    }
+
+    // ---- UDP ---------------------------------------------------------------
+
+    void startUdp(unsigned short port)
+    {
+        int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            throw std::runtime_error(std::string("bind failed: ") + std::strerror(errno));
+        }
+
+        // the socket is fixed file 0
+        int ret = io_uring_register_files(&ring, &fd, 1);
+        if (ret < 0)
+        {
+            throw std::runtime_error(std::string("io_uring_register_files failed: ") + std::strerror(-ret));
+        }
+
+        udp_msg = msghdr{};
+        udp_msg.msg_namelen = sizeof(sockaddr_storage);
+
+        std::cout << "Server listening on port " << port << " (UDP, io_uring)..." << std::endl;
+        armUdpRecv();
+    }
+
+    void armUdpRecv()
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (multishot_recv)
+        {
+            io_uring_prep_recvmsg_multishot(sqe, 0, &udp_msg, 0);
+        }
+        else
+        {
+            // single-shot recvmsg with a selected buffer fills udp_msg directly
+            udp_single_iov.iov_base = nullptr;
+            udp_single_iov.iov_len = recv_buffer_size;
+            udp_msg.msg_name = &udp_single_name;
+            udp_msg.msg_namelen = sizeof(sockaddr_storage);
+            udp_msg.msg_iov = &udp_single_iov;
+            udp_msg.msg_iovlen = 1;
+            io_uring_prep_recvmsg(sqe, 0, &udp_msg, 0);
+        }
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+        sqe->buf_group = recv_buffer_group;
+        io_uring_sqe_set_data64(sqe, encode(Op::UdpRecv));
+    }
+
+    void onUdpRecv(io_uring_cqe* cqe)
+    {
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            const char* buffer = bufferOf(cqe);
+            udp::endpoint sender;
+            const char* payload;
+            size_t length;
+            if (multishot_recv)
+            {
+                auto* out = io_uring_recvmsg_validate(const_cast<char*>(buffer), cqe->res, &udp_msg);
+                if (!out)
+                {
+                    recycleBuffer(cqe);
+                    if (!more)
+                    {
+                        armUdpRecv();
+                    }
+                    return;
+                }
+                socklen_t name_len = std::min<socklen_t>(out->namelen, sizeof(sockaddr_storage));
+                sender.resize(name_len);
+                std::memcpy(sender.data(), io_uring_recvmsg_name(out), name_len);
+                payload = static_cast<const char*>(io_uring_recvmsg_payload(out, &udp_msg));
+                length = io_uring_recvmsg_payload_length(out, cqe->res, &udp_msg);
+            }
+            else
+            {
+                sender.resize(udp_msg.msg_namelen);
+                std::memcpy(sender.data(), &udp_single_name, udp_msg.msg_namelen);
+                payload = buffer;
+                length = static_cast<size_t>(cqe->res);
+            }
+
+            auto inserted = udp_clients.insert(sender);
+            if (inserted.second)
+            {
+                LOG_INFO("Client connected: {}", sender);
+            }
+            if (length > 0)
+            {
+                broadcastUdp(payload, length);
+            }
+            recycleBuffer(cqe);
+        }
+        else if (cqe->res == -EINVAL && multishot_recv)
+        {
+            LOG_INFO("Multishot recvmsg not supported, falling back to single-shot");
+            multishot_recv = false;
+        }
+        else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+        {
+            LOG_WARN("Receive error: {}", std::strerror(-cqe->res));
+        }
+
+        if (!more)
+        {
+            armUdpRecv();
+        }
+    }
+
+    void broadcastUdp(const char* data, size_t size)
+    {
+        metrics::received(size);
+        auto start = std::chrono::high_resolution_clock::now();
+        auto* broadcast = new UdpBroadcast();
+        broadcast->payload.assign(data, size);
+        broadcast->iov.iov_base = broadcast->payload.data();
+        broadcast->iov.iov_len = broadcast->payload.size();
+        broadcast->headers.resize(udp_clients.size());
+        broadcast->pending = udp_clients.size();
+
+        // std::set nodes are never erased here, so msg_name can point straight at them
+        size_t i = 0;
+        for (const auto& ep : udp_clients)
+        {
+            msghdr& hdr = broadcast->headers[i++];
+            hdr.msg_name = const_cast<sockaddr*>(ep.data());
+            hdr.msg_namelen = static_cast<socklen_t>(ep.size());
+            hdr.msg_iov = &broadcast->iov;
+            hdr.msg_iovlen = 1;
+
+            io_uring_sqe* sqe = getSqe();
+            io_uring_prep_sendmsg(sqe, 0, &hdr, 0);
+            sqe->flags |= IOSQE_FIXED_FILE;
+            io_uring_sqe_set_data64(sqe, encode(Op::UdpSend, broadcast));
+        }
+        submit();
+        metrics::queued(static_cast<int64_t>(udp_clients.size())); // sendmsg requests in flight
+        auto end = std::chrono::high_resolution_clock::now();
+        metrics::fanout(end - start);
+    }
+
+    bool udp_mode;
+    bool binary_mode;
+    io_uring ring{};
+    std::deque<io_uring_cqe> deferred; // reaped, not handled yet
+    io_uring_buf_ring* buf_ring = nullptr;
+    std::vector<char> recv_buffers;
+    std::vector<char> send_slab;
+    std::vector<int> free_slots;
+    bool multishot_accept = true;
+    bool multishot_recv = true;
+
+    int listen_fd = -1;
+    std::vector<Connection*> active;
+
+    msghdr udp_msg{};
+    iovec udp_single_iov{};
+    sockaddr_storage udp_single_name{};
+    std::set<udp::endpoint> udp_clients;
+};
+
+int main(int argc, char* argv[])
+{
+    CommandLine args(argc, argv);
+    if (args.size() < 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " <port> [--udp] [--binary] [metrics options]" << std::endl;
+        std::cerr << "  --udp     serve UDPSimpleBroadcastLoadTest instead of TCPSimpleBroadcastLoadTest" << std::endl;
+        std::cerr << "  --binary  TCP clients send length-prefixed binary frames instead of text lines" << std::endl;
+        metrics::print_usage(std::cerr);
+        return 1;
+    }
+
+    unsigned short port = static_cast<unsigned short>(std::stoi(args[0]));
+
+    // write_fixed on a socket whose peer went away must not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+    metrics::start_reporting(args, "SimpleBroadcastIoUringServer");
+
+    try
+    {
+        IoUringServer server(args.has("udp"), args.has("binary"));
+        server.run(port);
+    }
+    catch (std::exception& e)
+    {
+        LOG_ERROR("Server error: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
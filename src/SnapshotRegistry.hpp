@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+// Copy-on-write membership set for hot fan-out paths.
+// Membership changes (rare) copy the sorted member list under a writer mutex and
+// publish it as a new immutable snapshot. Readers keep a per-thread Reader that
+// only re-loads the shared snapshot when the version counter moved, so the
+// steady state is one atomic load per packet: no lock, no allocation, no copy.
+template <typename T>
+class SnapshotRegistry
+{
+public:
+    // Sorted, so membership checks are a binary search over the snapshot
+    using Snapshot = std::vector<T>;
+
+    class Reader
+    {
+    public:
+        explicit Reader(const SnapshotRegistry& registry)
+            : registry(registry)
+        {
+        }
+
+        // Valid until the next call to current() on this reader
+        const Snapshot& current()
+        {
+            uint64_t version = registry.version.load(std::memory_order_acquire);
+            if (!cached || version != seen_version)
+            {
+                cached = registry.snapshot.load(std::memory_order_acquire);
+                seen_version = version;
+            }
+            return *cached;
+        }
+
+        bool contains(const T& value)
+        {
+            const Snapshot& members = current();
+            return std::binary_search(members.begin(), members.end(), value);
+        }
+
+    private:
+        const SnapshotRegistry& registry;
+        std::shared_ptr<const Snapshot> cached;
+        uint64_t seen_version = 0;
+    };
+
+    SnapshotRegistry()
+        : snapshot(std::make_shared<const Snapshot>())
+    {
+    }
+
+    // Returns false if the value was already a member
+    bool insert(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        auto members = snapshot.load(std::memory_order_relaxed);
+        auto pos = std::lower_bound(members->begin(), members->end(), value);
+        if (pos != members->end() && !(value < *pos))
+        {
+            return false;
+        }
+
+        auto next = std::make_shared<Snapshot>();
+        next->reserve(members->size() + 1);
+        next->insert(next->end(), members->begin(), pos);
+        next->push_back(value);
+        next->insert(next->end(), pos, members->end());
+        publish(std::move(next));
+        return true;
+    }
+
+    // Returns false if the value was not a member
+    bool erase(const T& value)
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        auto members = snapshot.load(std::memory_order_relaxed);
+        auto pos = std::lower_bound(members->begin(), members->end(), value);
+        if (pos == members->end() || value < *pos)
+        {
+            return false;
+        }
+
+        auto next = std::make_shared<Snapshot>();
+        next->reserve(members->size() - 1);
+        next->insert(next->end(), members->begin(), pos);
+        next->insert(next->end(), pos + 1, members->end());
+        publish(std::move(next));
+        return true;
+    }
+
+    std::shared_ptr<const Snapshot> load() const
+    {
+        return snapshot.load(std::memory_order_acquire);
+    }
+
+private:
+    void publish(std::shared_ptr<Snapshot> next)
+    {
+        snapshot.store(std::move(next), std::memory_order_release);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    std::mutex writer_mutex;
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot;
+    std::atomic<uint64_t> version{0};
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer queue.
+// Exactly one thread may push and exactly one other thread may pop. Head and tail
+// sit on separate cache lines, and each side caches the other's index so the
+// common case touches no shared cache line apart from its own.
+template <typename T>
+class SpscRing
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    // Producer side. Returns false (and leaves value untouched) when the ring is full.
+    bool try_push(T&& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size())
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size())
+            {
+                return false;
+            }
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& value)
+    {
+        T copy(value);
+        return try_push(std::move(copy));
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool try_pop(T& out)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+            {
+                return false;
+            }
+        }
+        out = std::move(slots[h & mask]);
+        slots[h & mask] = T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    alignas(64) std::atomic<size_t> head{0}; // written by the consumer
+    size_t cached_tail = 0;                  // consumer's view of tail
+
+    alignas(64) std::atomic<size_t> tail{0}; // written by the producer
+    size_t cached_head = 0;                  // producer's view of head
+};
\ No newline at end of file
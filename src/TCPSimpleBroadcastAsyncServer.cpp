@@ -1,61 +1,277 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <boost/asio.hpp>
 #include <boost/asio/io_context.hpp>
 #include <unordered_set>
 #include <chrono>
+#include "CommandLine.hpp"
+#include "TickAggregator.hpp"
+#include "WireProtocol.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+#include "InterestGrid.hpp"
 
 using boost::asio::awaitable;
 using boost::asio::co_spawn;
 using boost::asio::detached;
+using boost::asio::redirect_error;
 using boost::asio::ip::tcp;
 using boost::asio::use_awaitable;
 using boost::asio::io_context;
 using namespace std;
 
-static unordered_set< std::shared_ptr<tcp::socket> > connectedSockets;
+// One immutable copy of every broadcast payload, shared by all recipients' queues
+using SharedMessage = std::shared_ptr<const string>;
 
-awaitable<void> session(std::shared_ptr<tcp::socket> socket)
+// Every session lives on its own strand and owns a reader and a writer coroutine.
+// A broadcast only posts the message into each recipient's outbound queue, so the
+// sender never waits for other clients' sockets and the writes of different
+// sessions proceed in parallel on the io_context thread pool.
+// The writer drains everything queued since its last wakeup with one gathered write.
+class Session : public std::enable_shared_from_this<Session>
 {
-  connectedSockets.insert(socket);
-  cout << "Client connected: " << socket->remote_endpoint() << '\n';
+public:
+  explicit Session(tcp::socket s)
+    : socket(move(s)), signal(socket.get_executor())
+  {
+    // The timer never fires on its own; it is cancelled to wake the writer.
+    signal.expires_at(std::chrono::steady_clock::time_point::max());
+  }
+
+  void start()
+  {
+    auto self = shared_from_this();
+    co_spawn(socket.get_executor(), [self] { return self->reader(); }, detached);
+    co_spawn(socket.get_executor(), [self] { return self->writer(); }, detached);
+  }
+
+  // Safe to call from any thread, the queue is only touched on the session's strand.
+  void deliver(SharedMessage msg)
+  {
+    boost::asio::post(socket.get_executor(), [self = shared_from_this(), msg = move(msg)]() mutable
+    {
+      if (!self->socket.is_open())
+      {
+        return; // the writer has already left
+      }
+      self->outbound.push_back(move(msg));
+      metrics::queued(1);
+      self->signal.cancel_one();
+    });
+  }
+
+private:
+  awaitable<void> reader();
+  awaitable<void> readLines();
+  awaitable<void> readFrames();
+  awaitable<void> writer();
+
+  void stop()
+  {
+    boost::system::error_code ignored_ec;
+    socket.close(ignored_ec);
+    signal.cancel();
+  }
+
+  tcp::socket socket;
+  boost::asio::steady_timer signal;
+  deque<SharedMessage> outbound;
+};
+
+static mutex sessionsMutex;
+static unordered_set< std::shared_ptr<Session> > connectedSessions;
+
+// Tick mode: lines are collected here and sent as one write per client per tick
+static bool tickMode = false;
+static TickAggregator tickAggregator;
+
+// Binary mode: clients send length-prefixed wire frames instead of '\n'-terminated lines
+static bool binaryMode = false;
+
+// Interest mode: positioned messages only go to the sessions within the radius of their sender
+static unique_ptr<InterestGrid<std::shared_ptr<Session>>> interestGrid;
+
+void fanOut(const vector<std::shared_ptr<Session>>& recipients, const SharedMessage& data)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  for (auto& recipient : recipients)
+  {
+    recipient->deliver(data);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  metrics::fanout(end - start);
+}
+
+void broadcast(const SharedMessage& data)
+{
+  // Copy to avoid iterator invalidation and handle concurrent disconnects
+  vector<std::shared_ptr<Session>> recipients;
+  {
+    lock_guard<mutex> lock(sessionsMutex);
+    recipients.assign(connectedSessions.begin(), connectedSessions.end());
+  }
+  fanOut(recipients, data);
+}
+
+// Messages without a position still go to everyone
+void dispatch(const std::shared_ptr<Session>& sender, const char* data, size_t size)
+{
+  Position position;
+  if (interestGrid && read_position(data, size, binaryMode, position))
+  {
+    vector<std::shared_ptr<Session>> recipients;
+    interestGrid->move_and_collect(sender, position, recipients);
+    fanOut(recipients, std::make_shared<const string>(data, size));
+  }
+  else
+  {
+    broadcast(std::make_shared<const string>(data, size));
+  }
+}
+
+awaitable<void> Session::reader()
+{
+  {
+    lock_guard<mutex> lock(sessionsMutex);
+    connectedSessions.insert(shared_from_this());
+  }
+  LOG_INFO("Client connected: {}", socket.remote_endpoint());
   try
   {
-    string data;
-    while (true)
+    if (binaryMode)
+    {
+      co_await readFrames();
+    }
+    else
     {
-      data.clear();
-      co_await boost::asio::async_read_until(*socket, boost::asio::dynamic_buffer(data), '\n', use_awaitable); // line-by-line reading
-      if (data != "")
+      co_await readLines();
+    }
+  }
+  catch (const std::exception& e)
+  {
+    LOG_WARN("Session error: {}", e.what());
+  }
+
+  stop();
+  {
+    lock_guard<mutex> lock(sessionsMutex);
+    connectedSessions.erase(shared_from_this());
+  }
+  if (interestGrid)
+  {
+    interestGrid->remove(shared_from_this());
+  }
+  LOG_INFO("Client disconnected");
+}
+
+awaitable<void> Session::readLines()
+{
+  while (true)
+  {
+    string data; // handed off to the broadcast buffer below, so start fresh every line
+    co_await boost::asio::async_read_until(socket, boost::asio::dynamic_buffer(data), '\n', use_awaitable); // line-by-line reading
+    metrics::received(data.size());
+    if (data != "" && tickMode)
+    {
+      tickAggregator.add(data.data(), data.size());
+    }
+    else if (data != "" && interestGrid)
+    {
+      dispatch(shared_from_this(), data.data(), data.size());
+    }
+    else if (data != "")
+    {
+      broadcast(std::make_shared<const string>(move(data)));
+    }
+  }
+}
+
+// Frames are forwarded verbatim, only the length prefix is looked at
+awaitable<void> Session::readFrames()
+{
+  wire::FrameBuffer inbound;
+  auto self = shared_from_this();
+  while (true)
+  {
+    size_t length = co_await socket.async_read_some(boost::asio::buffer(inbound.space(), inbound.space_size()), use_awaitable);
+    inbound.commit(length);
+    inbound.drain([&self](wire::MessageView frame)
+    {
+      metrics::received(frame.length());
+      if (tickMode)
       {
-        // Copy to avoid iterator invalidation and handle concurrent disconnects
-        vector<std::shared_ptr<tcp::socket>> recipients(connectedSockets.begin(), connectedSockets.end());
-        auto start = std::chrono::high_resolution_clock::now();
-        for (auto& recipient : recipients)
+        tickAggregator.add(frame.data(), frame.length());
+      }
+      else
+      {
+        dispatch(self, frame.data(), frame.length());
+      }
+    });
+  }
+}
+
+awaitable<void> Session::writer()
+{
+  try
+  {
+    vector<boost::asio::const_buffer> pending;
+    while (socket.is_open())
+    {
+      if (outbound.empty())
+      {
+        boost::system::error_code ec;
+        co_await signal.async_wait(redirect_error(use_awaitable, ec));
+      }
+      else
+      {
+        // Messages queued while this write is in flight are picked up by the next batch
+        size_t count = outbound.size();
+        pending.clear();
+        for (size_t i = 0; i < count; ++i)
         {
-          try 
-          {
-            co_await boost::asio::async_write(*recipient, boost::asio::buffer(data), use_awaitable);
-          } 
-          catch (const std::exception& e) 
-          {
-            cerr << "Write error: " << e.what() << endl;
-          }
+          pending.push_back(boost::asio::buffer(*outbound[i]));
         }
-        auto end = std::chrono::high_resolution_clock::now();
-        cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << endl;
+        size_t written = co_await boost::asio::async_write(socket, pending, use_awaitable);
+        outbound.erase(outbound.begin(), outbound.begin() + count);
+        metrics::queued(-static_cast<int64_t>(count));
+        metrics::sent(written, count);
       }
     }
   }
-  catch (const std::exception& e) 
+  catch (const std::exception& e)
   {
-    cerr << "Session error: " << e.what() << endl;
+    LOG_WARN("Write error: {}", e.what());
+    metrics::send_error();
+    stop();
   }
+  metrics::queued(-static_cast<int64_t>(outbound.size()));
+  outbound.clear();
+}
 
-  connectedSockets.erase(socket);
-  cout << "Client disconnected" << endl;
+awaitable<void> ticker(io_context& ctx, std::chrono::steady_clock::duration period)
+{
+  boost::asio::steady_timer timer(ctx);
+  auto next = std::chrono::steady_clock::now() + period;
+  vector<string> packets;
+  while (true)
+  {
+    // Fixed schedule, so a slow tick does not shift every later one
+    timer.expires_at(next);
+    co_await timer.async_wait(use_awaitable);
+    next += period;
+
+    packets.clear();
+    tickAggregator.take(packets);
+    for (auto& packet : packets)
+    {
+      broadcast(std::make_shared<const string>(move(packet)));
+    }
+  }
 }
 
 awaitable<void> listener(io_context& ctx, unsigned short port)
@@ -64,28 +280,83 @@ awaitable<void> listener(io_context& ctx, unsigned short port)
   cout << "Server listening on port " << port << "..." << endl;
   while (true)
   {
-    tcp::socket socket = co_await acceptor.async_accept(use_awaitable);
-    auto socketPtr = std::make_shared<tcp::socket>(move(socket));
-    co_spawn(ctx, session(socketPtr), detached);
+    // Each accepted socket gets its own strand, so the session's coroutines never run concurrently
+    tcp::socket socket(boost::asio::make_strand(ctx));
+    co_await acceptor.async_accept(socket, use_awaitable);
+    std::make_shared<Session>(move(socket))->start();
   }
 }
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  CommandLine args(argc, argv);
+  if (args.size() < 1)
   {
-    cerr << "Usage: " << argv[0] << " <port>" << endl;
+    cerr << "Usage: " << argv[0] << " <port> [--threads=N] [--tick-rate=HZ] [--binary] [--interest-radius=R [--cell-size=C]] [metrics options]" << endl;
+    cerr << "  --threads=N           io_context threads (default 1, 0 = hardware concurrency)" << endl;
+    cerr << "  --tick-rate=HZ        aggregate lines and send them once per tick (default 0 = echo immediately)" << endl;
+    cerr << "  --binary              length-prefixed binary frames instead of text lines" << endl;
+    cerr << "  --interest-radius=R   send positioned messages only to clients within R of the sender" << endl;
+    cerr << "  --cell-size=C         interest grid cell size (default R, at least R/16)" << endl;
+    metrics::print_usage(cerr);
     return 1;
   }
 
-  io_context ctx;
-  string arg = argv[1];
+  unsigned int thread_count = static_cast<unsigned int>(args.getInt("threads", 1));
+  if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+  if (thread_count == 0) thread_count = 4;
+
+  io_context ctx(static_cast<int>(thread_count));
+  string arg = args[0];
   size_t pos;
   unsigned short port = stoi(arg, &pos);
 
+  binaryMode = args.has("binary");
+
+  double tick_rate = args.getDouble("tick-rate", 0);
+  double interest_radius = args.getDouble("interest-radius", 0);
+  if (interest_radius > 0 && tick_rate > 0)
+  {
+    cerr << "--interest-radius cannot be combined with --tick-rate" << endl;
+    return 1;
+  }
+  double cell_size = args.getDouble("cell-size", interest_radius);
+  if (interest_radius > 0 && cell_size < min_cell_size(static_cast<float>(interest_radius)))
+  {
+    cerr << "--cell-size must be at least " << min_cell_size(static_cast<float>(interest_radius)) << " (R/16)" << endl;
+    return 1;
+  }
+  if (interest_radius > 0)
+  {
+    interestGrid = std::make_unique<InterestGrid<std::shared_ptr<Session>>>(
+      static_cast<float>(interest_radius), static_cast<float>(cell_size));
+    cout << "Interest radius: " << interest_radius << endl;
+  }
+
   boost::asio::signal_set signals(ctx, SIGINT, SIGTERM);
   signals.async_wait([&](auto, auto) { ctx.stop(); });
   auto listen = listener(ctx, port);
   co_spawn(ctx, move(listen), boost::asio::detached);
+
+  if (tick_rate > 0)
+  {
+    tickMode = true;
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / tick_rate));
+    cout << "Tick mode: " << tick_rate << " Hz" << endl;
+    co_spawn(ctx, ticker(ctx, period), boost::asio::detached);
+  }
+
+  metrics::start_reporting(args, "TCPSimpleBroadcastAsyncServer");
+  cout << "Running " << thread_count << " io_context thread(s)" << endl;
+  vector<thread> threads;
+  for (unsigned int i = 1; i < thread_count; ++i)
+  {
+    threads.emplace_back([&ctx] { ctx.run(); });
+  }
   ctx.run();
+
+  for (auto& t : threads)
+  {
+    t.join();
+  }
 }
\ No newline at end of file
@@ -10,15 +10,130 @@
 #include <boost/asio.hpp>
 #include <functional>
 #include <latch>
+#include <fstream>
+#include "CommandLine.hpp"
+#include "WireProtocol.hpp"
+#include "LatencyHistogram.hpp"
+#include "CoroutineClientPool.hpp"
+#include "CpuAffinity.hpp"
+#include "LatencyTimeSeries.hpp"
+#include "InterestGrid.hpp"
 
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
 using boost::asio::ip::tcp;
 
+// Each client records into its own histogram without locking and merges it here once at the end
 std::mutex latencies_mutex;
-std::vector<long long> latencies;
+LatencyHistogram latencies;
 std::atomic<int> errors{0};
+// Every message any client received, own echoes or not, to show the fan-out per message
+std::atomic<uint64_t> messages_received{0};
+
+// Binary mode: send and match length-prefixed wire frames instead of "timestamp|id" lines
+bool binary_mode = false;
+
+// CPUs the client threads are pinned to (round-robin), empty = no pinning
+std::vector<int> client_cpus;
+
+long long now_us()
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+// Open-loop mode: every client sends 'rate' messages per second for 'duration'
+double open_loop_rate = 0;
+std::chrono::seconds open_loop_duration(10);
+// How long clients keep listening after their last scheduled send
+constexpr std::chrono::seconds open_loop_drain(2);
+
+// --payload=N pads every message with N filler bytes
+std::string payload_padding;
+
+// --world=W: clients move around a W x W square and every message carries the sender's position
+float world_size = 0;
+float move_speed = 10;
+std::chrono::steady_clock::time_point run_start;
+
+Position current_position(int id)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    return simulated_position(id, seconds, world_size, move_speed);
+}
+
+// Prepare message: timestamp|id (timestamp|@x,y|padding|id with --world and --payload), or one wire frame carrying them
+std::string make_message(int id, long long timestamp = now_us(), uint32_t sequence = 0)
+{
+    if (binary_mode && world_size > 0)
+    {
+        std::string payload(wire::position_size, '\0');
+        Position position = current_position(id);
+        wire::store_position(payload.data(), position.x, position.y);
+        payload += payload_padding;
+        return wire::encode(wire::MessageType::PositionedBroadcast, static_cast<uint32_t>(id), sequence, timestamp, payload.data(), payload.size());
+    }
+    if (binary_mode)
+    {
+        return wire::encode(wire::MessageType::Broadcast, static_cast<uint32_t>(id), sequence, timestamp, payload_padding.data(), payload_padding.size());
+    }
+    std::string position = world_size > 0 ? format_position(current_position(id)) + "|" : "";
+    std::string padding = payload_padding.empty() ? "" : payload_padding + "|";
+    return std::to_string(timestamp) + "|" + position + padding + std::to_string(id) + "\n";
+}
+
+// Send timestamp of the line if it is this client's own echo, otherwise -1
+long long own_timestamp(std::string& line, int id)
+{
+    if (!line.empty() && line.back() == '\r') 
+    {
+        line.pop_back();
+    }
+
+    // Exact suffix, so client 1 does not take client 12's messages for its own
+    std::string suffix = "|" + std::to_string(id);
+    if (line.size() > suffix.size() && line.compare(line.size() - suffix.size(), suffix.size(), suffix) == 0) 
+    {
+        try 
+        {
+            return std::stoll(line.substr(0, line.size() - suffix.size()));
+        } 
+        catch (...) 
+        {
+        }
+    }
+    return -1;
+}
+
+// Frames are matched in place: no search, no substring, no number parsing
+long long own_timestamp(wire::MessageView frame, int id)
+{
+    return frame.sender() == static_cast<uint32_t>(id) ? frame.timestamp() : -1;
+}
+
+// Records the RTT if the message is this client's own echo
+template <typename Message>
+bool record_own(Message&& message, int id, LatencyHistogram& histogram)
+{
+    messages_received.fetch_add(1, std::memory_order_relaxed);
+    long long sent_ts = own_timestamp(message, id);
+    if (sent_ts < 0)
+    {
+        return false;
+    }
+    // save latency data for this client
+    histogram.record(now_us() - sent_ts);
+    return true;
+}
 
 void run_client(int id, const std::string& host, const std::string& port, std::latch& start_latch)
 {
+    if (!client_cpus.empty())
+    {
+        pin_this_thread(client_cpus[static_cast<size_t>(id) % client_cpus.size()]);
+    }
+
+    LatencyHistogram histogram;
     bool connected = false;
     try
     {
@@ -31,10 +146,7 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
         start_latch.arrive_and_wait();
         connected = true;
 
-        // Prepare message: timestamp|id
-        auto now = std::chrono::high_resolution_clock::now();
-        long long timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-        std::string msg = std::to_string(timestamp) + "|" + std::to_string(id) + "\n";
+        std::string msg = make_message(id);
 
         boost::asio::write(socket, boost::asio::buffer(msg));
 
@@ -68,39 +180,47 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
             std::istream is(&buffer);
             std::string line;
             std::getline(is, line);
-            
-            if (!line.empty() && line.back() == '\r') 
+            if (record_own(line, id, histogram))
             {
-                line.pop_back();
+                foundMyMessage = true;
             }
+            
+            boost::asio::async_read_until(socket, buffer, "\n", read_handler);
+        };
 
-            std::string suffix = "|" + std::to_string(id);
-            if (line.find(suffix) != std::string::npos) 
+        wire::FrameBuffer frames;
+        std::function<void(boost::system::error_code, std::size_t)> frame_handler;
+        frame_handler = [&](boost::system::error_code ec, std::size_t length)
+        {
+            if (ec)
             {
-                auto end = std::chrono::high_resolution_clock::now();
-                long long current = std::chrono::duration_cast<std::chrono::microseconds>(end.time_since_epoch()).count();
-                size_t delim = line.find('|');
-                if (delim != std::string::npos) 
+                if (!foundMyMessage && ec != boost::asio::error::operation_aborted)
                 {
-                    try 
-                    {
-                        long long sent_ts = std::stoll(line.substr(0, delim));
-                        long long rtt = current - sent_ts;
-                        std::lock_guard<std::mutex> lock(latencies_mutex);
-                        // save latency data for this client
-                        latencies.push_back(rtt);
-                        foundMyMessage = true;
-                    } 
-                    catch (...) 
-                    {
-                    }
+                    errors++;
                 }
+                return;
             }
-            
-            boost::asio::async_read_until(socket, buffer, "\n", read_handler);
+
+            frames.commit(length);
+            frames.drain([&](wire::MessageView frame)
+            {
+                if (record_own(frame, id, histogram))
+                {
+                    foundMyMessage = true;
+                }
+            });
+
+            socket.async_read_some(boost::asio::buffer(frames.space(), frames.space_size()), frame_handler);
         };
 
-        boost::asio::async_read_until(socket, buffer, "\n", read_handler);
+        if (binary_mode)
+        {
+            socket.async_read_some(boost::asio::buffer(frames.space(), frames.space_size()), frame_handler);
+        }
+        else
+        {
+            boost::asio::async_read_until(socket, buffer, "\n", read_handler);
+        }
         io_context.run();
     }
     catch (const std::exception& e)
@@ -111,37 +231,283 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
         }
         errors++;
     }
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    latencies.merge(histogram);
+}
+
+// Same client as run_client, as a coroutine sharing its worker thread with many others
+awaitable<void> run_coroutine_client(int id, tcp::resolver::results_type endpoints, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    tcp::socket socket(worker.ctx);
+    try
+    {
+        co_await boost::asio::async_connect(socket, endpoints, use_awaitable);
+    }
+    catch (const std::exception& e)
+    {
+        pool.arrive();
+        errors++;
+        co_return;
+    }
+
+    // wait until all clients are connected before sending messages
+    co_await pool.arrive_and_wait(worker);
+
+    bool foundMyMessage = false;
+    try
+    {
+        std::string msg = make_message(id);
+        co_await boost::asio::async_write(socket, boost::asio::buffer(msg), use_awaitable);
+
+        // keep connecting for up to 10 seconds to receive as many broadcasted messages as possible
+        boost::asio::steady_timer timer(worker.ctx);
+        timer.expires_after(std::chrono::seconds(10));
+        timer.async_wait([&](const boost::system::error_code& ec) 
+        {
+            if (!ec) 
+            {
+                socket.close();
+            }
+        });
+
+        if (binary_mode)
+        {
+            wire::FrameBuffer frames;
+            while (true)
+            {
+                size_t length = co_await socket.async_read_some(boost::asio::buffer(frames.space(), frames.space_size()), use_awaitable);
+                frames.commit(length);
+                frames.drain([&](wire::MessageView frame)
+                {
+                    if (record_own(frame, id, worker.histogram))
+                    {
+                        foundMyMessage = true;
+                    }
+                });
+            }
+        }
+        else
+        {
+            boost::asio::streambuf buffer;
+            while (true)
+            {
+                co_await boost::asio::async_read_until(socket, buffer, "\n", use_awaitable);
+                std::istream is(&buffer);
+                std::string line;
+                std::getline(is, line);
+                if (record_own(line, id, worker.histogram))
+                {
+                    foundMyMessage = true;
+                }
+            }
+        }
+    }
+    catch (const boost::system::system_error& e)
+    {
+        if (!foundMyMessage && e.code() != boost::asio::error::operation_aborted) 
+        {
+            errors++;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        errors++;
+    }
+}
+
+size_t second_of(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point t)
+{
+    return t < start ? 0 : static_cast<size_t>(std::chrono::duration_cast<std::chrono::seconds>(t - start).count());
+}
+
+// Counts every received message and records the latency of the client's own echoes,
+// filed under the second the echoed message was scheduled in
+template <typename Message>
+void record_open_loop(Message&& message, int id, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    messages_received.fetch_add(1, std::memory_order_relaxed);
+    auto now = std::chrono::steady_clock::now();
+    worker.series.record_received(second_of(pool.start_time(), now));
+
+    long long sent_ts = own_timestamp(message, id);
+    if (sent_ts >= 0)
+    {
+        long long rtt = now_us() - sent_ts;
+        worker.histogram.record(rtt);
+        worker.series.record_latency(second_of(pool.start_time(), now - std::chrono::microseconds(rtt)), rtt);
+    }
+}
+
+awaitable<void> read_open_loop(std::shared_ptr<tcp::socket> socket, int id, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    try
+    {
+        if (binary_mode)
+        {
+            wire::FrameBuffer frames;
+            while (true)
+            {
+                size_t length = co_await socket->async_read_some(boost::asio::buffer(frames.space(), frames.space_size()), use_awaitable);
+                frames.commit(length);
+                frames.drain([&](wire::MessageView frame) { record_open_loop(frame, id, pool, worker); });
+            }
+        }
+        else
+        {
+            boost::asio::streambuf buffer;
+            while (true)
+            {
+                co_await boost::asio::async_read_until(*socket, buffer, "\n", use_awaitable);
+                std::istream is(&buffer);
+                std::string line;
+                std::getline(is, line);
+                record_open_loop(line, id, pool, worker);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // closed by the sender after the drain period
+    }
+}
+
+// Open-loop client: sends on a fixed schedule no matter how fast echoes come back.
+// Each message carries its *scheduled* send time, so when the client falls behind
+// (a blocked write, a busy io thread) the delay counts as latency instead of silently
+// thinning out the load -- the coordinated omission correction.
+awaitable<void> run_open_loop_client(int id, int clients, tcp::resolver::results_type endpoints, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    auto socket = std::make_shared<tcp::socket>(worker.ctx);
+    try
+    {
+        co_await boost::asio::async_connect(*socket, endpoints, use_awaitable);
+    }
+    catch (const std::exception& e)
+    {
+        pool.arrive();
+        errors++;
+        co_return;
+    }
+
+    co_await pool.arrive_and_wait(worker);
+    boost::asio::co_spawn(worker.ctx, read_open_loop(socket, id, pool, worker), boost::asio::detached);
+
+    // Clients are phase-shifted evenly across one period instead of all sending at once
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / open_loop_rate));
+    auto start = pool.start_time();
+    auto end = start + open_loop_duration;
+    auto next = start + period * id / clients;
+
+    boost::asio::steady_timer timer(worker.ctx);
+    try
+    {
+        for (uint32_t sequence = 0; next < end; ++sequence, next += period)
+        {
+            timer.expires_at(next);
+            co_await timer.async_wait(use_awaitable);
+
+            long long lag = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - next).count();
+            std::string msg = make_message(id, now_us() - lag, sequence);
+            co_await boost::asio::async_write(*socket, boost::asio::buffer(msg), use_awaitable);
+            worker.series.record_sent(second_of(start, next));
+        }
+
+        timer.expires_after(open_loop_drain);
+        co_await timer.async_wait(use_awaitable);
+    }
+    catch (const std::exception& e)
+    {
+        errors++;
+    }
+
+    boost::system::error_code ignored_ec;
+    socket->close(ignored_ec);
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc < 4)
+    CommandLine args(argc, argv);
+    if (args.size() < 3)
     {
-        std::cerr << "Usage: " << argv[0] << " <host> <port> <clients>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <host> <port> <clients> [--binary] [--histogram[=FILE]] [--coroutines] [--io-threads=N] [--cpus=LIST] [--rate=R] [--duration=S] [--payload=N] [--world=W [--speed=S]]" << std::endl;
+        std::cerr << "  --binary            length-prefixed binary frames (start the server with --binary too)" << std::endl;
+        std::cerr << "  --histogram[=FILE]  also print the full latency distribution (to FILE if given)" << std::endl;
+        std::cerr << "  --coroutines        run clients as coroutines on a few io threads instead of one thread each" << std::endl;
+        std::cerr << "  --io-threads=N      io threads in coroutine mode (default 1, 0 = hardware concurrency)" << std::endl;
+        std::cerr << "  --cpus=LIST         pin load test threads to these CPUs, e.g. 0-3,8 (default: no pinning)" << std::endl;
+        std::cerr << "  --rate=R            open loop: every client sends R messages/s on a fixed schedule (implies --coroutines)" << std::endl;
+        std::cerr << "  --duration=S        open-loop sending time in seconds (default 10)" << std::endl;
+        std::cerr << "  --payload=N         pad every message with N bytes (default 0)" << std::endl;
+        std::cerr << "  --world=W           clients move around a W x W world and send their position (server --interest-radius)" << std::endl;
+        std::cerr << "  --speed=S           movement speed in world units per second (default 10)" << std::endl;
         return 1;
     }
 
-    std::string host = argv[1];
-    std::string port = argv[2];
-    int num_clients = std::stoi(argv[3]);
+    std::string host = args[0];
+    std::string port = args[1];
+    int num_clients = std::stoi(args[2]);
+    binary_mode = args.has("binary");
+    client_cpus = parse_cpu_list(args.get("cpus"));
+    open_loop_rate = args.getDouble("rate", 0);
+    open_loop_duration = std::chrono::seconds(std::max(1LL, args.getInt("duration", 10)));
+    payload_padding.assign(static_cast<size_t>(std::max(0LL, args.getInt("payload", 0))), 'x');
+    world_size = static_cast<float>(std::max(0.0, args.getDouble("world", 0)));
+    move_speed = static_cast<float>(args.getDouble("speed", 10));
+    run_start = std::chrono::steady_clock::now();
+    LatencyTimeSeries series;
 
     std::cout << "Spawning " << num_clients << " clients connecting to " << host << ":" << port << "..." << std::endl;
-    std::vector<std::thread> threads;
-    threads.reserve(num_clients);
-
     auto start = std::chrono::high_resolution_clock::now();
-    std::latch start_latch(num_clients);
 
-    for (int i = 0; i < num_clients; ++i)
+    if (args.has("coroutines") || open_loop_rate > 0)
     {
-        threads.emplace_back(run_client, i, host, port, std::ref(start_latch));
-    }
+        size_t io_threads = static_cast<size_t>(args.getInt("io-threads", 1));
+        if (io_threads == 0) io_threads = std::max(1u, std::thread::hardware_concurrency());
 
-    for (auto& t : threads)
+        boost::asio::io_context resolve_ctx;
+        auto endpoints = tcp::resolver(resolve_ctx).resolve(host, port);
+
+        CoroutineClientPool pool(io_threads, num_clients, client_cpus);
+        std::cout << "Coroutine mode: " << pool.size() << " io thread(s)" << std::endl;
+        for (int i = 0; i < num_clients; ++i)
+        {
+            auto& worker = pool.worker_for(i);
+            if (open_loop_rate > 0)
+            {
+                worker.series.resize(static_cast<size_t>((open_loop_duration + open_loop_drain).count()));
+                boost::asio::co_spawn(worker.ctx, run_open_loop_client(i, num_clients, endpoints, pool, worker), boost::asio::detached);
+            }
+            else
+            {
+                boost::asio::co_spawn(worker.ctx, run_coroutine_client(i, endpoints, pool, worker), boost::asio::detached);
+            }
+        }
+        if (open_loop_rate > 0)
+        {
+            std::cout << "Open loop: " << open_loop_rate << " msg/s per client for " << open_loop_duration.count() << "s" << std::endl;
+        }
+        pool.run();
+        pool.merge_into(latencies);
+        pool.merge_into(series);
+    }
+    else
     {
-        if (t.joinable()) 
+        std::vector<std::thread> threads;
+        threads.reserve(num_clients);
+        std::latch start_latch(num_clients);
+
+        for (int i = 0; i < num_clients; ++i)
         {
-            t.join();
+            threads.emplace_back(run_client, i, host, port, std::ref(start_latch));
+        }
+
+        for (auto& t : threads)
+        {
+            if (t.joinable()) 
+            {
+                t.join();
+            }
         }
     }
 
@@ -150,14 +516,34 @@ int main(int argc, char* argv[])
 
     std::cout << "Finished " << num_clients << " clients in " << duration << "ms" << std::endl;
     std::cout << "Errors: " << errors << std::endl;
+    std::cout << "Messages received: " << messages_received << " (avg " << (num_clients > 0 ? messages_received / num_clients : 0) << " per client)" << std::endl;
+
+    if (latencies.count() > 0)
+    {
+        latencies.print_summary(std::cout);
+    }
 
-    if (!latencies.empty())
+    if (open_loop_rate > 0)
     {
-        long long min_val = *std::min_element(latencies.begin(), latencies.end());
-        long long max_val = *std::max_element(latencies.begin(), latencies.end());
-        long long sum = std::accumulate(latencies.begin(), latencies.end(), 0LL);
-        double avg = static_cast<double>(sum) / latencies.size();
-        std::cout << "Latency (us) -> Min: " << min_val << ", Max: " << max_val << ", Avg: " << avg << std::endl;
+        uint64_t sent = series.total_sent();
+        uint64_t echoes = series.total_echoes();
+        std::cout << "Open loop: sent " << sent << ", own echoes " << echoes << ", lost " << (sent - std::min(sent, echoes)) << std::endl;
+        series.print(std::cout);
+    }
+
+    // --histogram prints the full distribution, --histogram=FILE writes it to a file
+    if (args.has("histogram"))
+    {
+        std::string path = args.get("histogram");
+        if (path.empty())
+        {
+            latencies.print_distribution(std::cout);
+        }
+        else
+        {
+            std::ofstream file(path);
+            latencies.print_distribution(file);
+        }
     }
 
     return 0;
@@ -0,0 +1,365 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <unordered_set>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <algorithm>
+#include "CommandLine.hpp"
+#include "SpscRing.hpp"
+#include "CpuAffinity.hpp"
+#include "WireProtocol.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+using boost::asio::awaitable;
+using boost::asio::co_spawn;
+using boost::asio::detached;
+using boost::asio::redirect_error;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+
+// Thread-per-core TCP server, the TCP counterpart of UDPSimpleBroadcastSO_REUSEPORTServer --sharded.
+// Every core thread runs its own single-threaded io_context with its own SO_REUSEPORT
+// listening socket, so the kernel spreads the connections over the cores and each one
+// is accepted, read and written by the same core for its whole life, with no locks or
+// strands. A message goes straight to the core's own clients and reaches every other
+// core through a lock-free SPSC ring per core pair. A core is only woken (one post) when
+// nothing is scheduled to drain its rings yet, so a burst of messages costs one wakeup.
+
+// One immutable copy of every broadcast payload, shared by all cores and recipients
+using SharedMessage = std::shared_ptr<const std::string>;
+
+struct Core;
+
+// Like the sessions of TCPSimpleBroadcastAsyncServer, minus the strand: a reader and a
+// writer coroutine, and an outbound queue the writer drains with one gathered write
+class Session : public std::enable_shared_from_this<Session>
+{
+public:
+    Session(tcp::socket s, Core& core)
+        : socket(std::move(s)), core(core), signal(socket.get_executor())
+    {
+        // The timer never fires on its own; it is cancelled to wake the writer.
+        signal.expires_at(std::chrono::steady_clock::time_point::max());
+    }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        co_spawn(socket.get_executor(), [self] { return self->reader(); }, detached);
+        co_spawn(socket.get_executor(), [self] { return self->writer(); }, detached);
+    }
+
+    // Only called on the owning core's thread
+    void deliver(const SharedMessage& message)
+    {
+        if (!socket.is_open())
+        {
+            return; // the writer has already left
+        }
+        outbound.push_back(message);
+        metrics::queued(1);
+        signal.cancel_one();
+    }
+
+private:
+    awaitable<void> reader();
+    awaitable<void> readLines();
+    awaitable<void> readFrames();
+    awaitable<void> writer();
+
+    void stop()
+    {
+        boost::system::error_code ignored_ec;
+        socket.close(ignored_ec);
+        signal.cancel();
+    }
+
+    tcp::socket socket;
+    Core& core;
+    boost::asio::steady_timer signal;
+    std::deque<SharedMessage> outbound;
+};
+
+struct Core
+{
+    Core(size_t index, size_t count, size_t ring_size)
+        : index(index), ctx(1), acceptor(ctx)
+    {
+        inbound.resize(count);
+        for (size_t from = 0; from < count; ++from)
+        {
+            if (from != index)
+            {
+                inbound[from] = std::make_unique<SpscRing<SharedMessage>>(ring_size);
+            }
+        }
+    }
+
+    // A message one of this core's clients sent
+    void broadcast(SharedMessage message);
+    // Runs on this core whenever another core pushed into its rings
+    void drain();
+
+    void deliver_local(const SharedMessage& message)
+    {
+        for (auto& session : sessions)
+        {
+            session->deliver(message);
+        }
+    }
+
+    size_t index;
+    boost::asio::io_context ctx;
+    tcp::acceptor acceptor;
+    std::unordered_set<std::shared_ptr<Session>> sessions; // this core's thread only
+
+    // inbound[i] is only pushed by core i and only popped by this core
+    std::vector<std::unique_ptr<SpscRing<SharedMessage>>> inbound;
+    std::atomic<bool> drain_scheduled{false};
+};
+
+std::vector<std::unique_ptr<Core>> cores;
+
+// Binary mode: clients send length-prefixed wire frames instead of '\n'-terminated lines
+bool binary_mode = false;
+
+void Core::broadcast(SharedMessage message)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    deliver_local(message);
+    for (auto& target : cores)
+    {
+        if (target.get() == this)
+        {
+            continue;
+        }
+        if (!target->inbound[index]->try_push(message))
+        {
+            metrics::dropped(); // counted rather than logged, this is the overload path
+            continue;
+        }
+        metrics::queued(1);
+        // Release pairs with the acquire in drain(): either the drain that is already
+        // scheduled sees this message, or this push schedules the next one
+        if (!target->drain_scheduled.exchange(true, std::memory_order_acq_rel))
+        {
+            boost::asio::post(target->ctx, [core = target.get()] { core->drain(); });
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    metrics::fanout(end - start);
+}
+
+void Core::drain()
+{
+    // Cleared before draining, so a push after this point schedules another drain
+    drain_scheduled.exchange(false, std::memory_order_acq_rel);
+    int64_t drained = 0;
+    SharedMessage message;
+    for (auto& ring : inbound)
+    {
+        while (ring && ring->try_pop(message))
+        {
+            deliver_local(message);
+            drained++;
+        }
+    }
+    metrics::queued(-drained);
+}
+
+awaitable<void> Session::reader()
+{
+    auto self = shared_from_this();
+    core.sessions.insert(self);
+    LOG_INFO("Client connected: {} on core {}", socket.remote_endpoint(), core.index);
+    try
+    {
+        if (binary_mode)
+        {
+            co_await readFrames();
+        }
+        else
+        {
+            co_await readLines();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARN("Session error: {}", e.what());
+    }
+
+    stop();
+    core.sessions.erase(self);
+    LOG_INFO("Client disconnected");
+}
+
+awaitable<void> Session::readLines()
+{
+    while (true)
+    {
+        std::string data; // handed off to the broadcast below, so start fresh every line
+        co_await boost::asio::async_read_until(socket, boost::asio::dynamic_buffer(data), '\n', use_awaitable);
+        metrics::received(data.size());
+        if (!data.empty())
+        {
+            core.broadcast(std::make_shared<const std::string>(std::move(data)));
+        }
+    }
+}
+
+// Frames are forwarded verbatim, only the length prefix is looked at
+awaitable<void> Session::readFrames()
+{
+    wire::FrameBuffer inbound;
+    while (true)
+    {
+        size_t length = co_await socket.async_read_some(boost::asio::buffer(inbound.space(), inbound.space_size()), use_awaitable);
+        inbound.commit(length);
+        inbound.drain([this](wire::MessageView frame)
+        {
+            metrics::received(frame.length());
+            core.broadcast(std::make_shared<const std::string>(frame.data(), frame.length()));
+        });
+    }
+}
+
+awaitable<void> Session::writer()
+{
+    try
+    {
+        std::vector<boost::asio::const_buffer> pending;
+        while (socket.is_open())
+        {
+            if (outbound.empty())
+            {
+                boost::system::error_code ec;
+                co_await signal.async_wait(redirect_error(use_awaitable, ec));
+            }
+            else
+            {
+                // Messages queued while this write is in flight are picked up by the next batch
+                size_t count = outbound.size();
+                pending.clear();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    pending.push_back(boost::asio::buffer(*outbound[i]));
+                }
+                size_t written = co_await boost::asio::async_write(socket, pending, use_awaitable);
+                outbound.erase(outbound.begin(), outbound.begin() + static_cast<std::ptrdiff_t>(count));
+                metrics::queued(-static_cast<int64_t>(count));
+                metrics::sent(written, count);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARN("Write error: {}", e.what());
+        metrics::send_error();
+        stop();
+    }
+    metrics::queued(-static_cast<int64_t>(outbound.size()));
+    outbound.clear();
+}
+
+awaitable<void> listener(Core& core)
+{
+    while (true)
+    {
+        tcp::socket socket(core.ctx);
+        co_await core.acceptor.async_accept(socket, use_awaitable);
+        std::make_shared<Session>(std::move(socket), core)->start();
+    }
+}
+
+void open_acceptor(tcp::acceptor& acceptor, unsigned short port)
+{
+    acceptor.open(tcp::v4());
+    acceptor.set_option(tcp::acceptor::reuse_address(true));
+
+#ifdef SO_REUSEPORT
+    int opt = 1;
+    if (setsockopt(acceptor.native_handle(), SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        std::cerr << "Failed to set SO_REUSEPORT" << std::endl;
+    }
+#endif
+
+    acceptor.bind(tcp::endpoint(tcp::v4(), port));
+    acceptor.listen();
+}
+
+int main(int argc, char* argv[])
+{
+    CommandLine args(argc, argv);
+    if (args.size() < 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " <port> [--threads=N] [--ring-size=N] [--cpus=LIST] [--binary] [metrics options]" << std::endl;
+        std::cerr << "  --threads=N     cores: threads with their own io_context and SO_REUSEPORT listener (default 0 = hardware concurrency)" << std::endl;
+        std::cerr << "  --ring-size=N   per core pair message ring capacity (default 4096)" << std::endl;
+        std::cerr << "  --cpus=LIST     pin the core threads to these CPUs round-robin, e.g. 0-3 (default: no pinning)" << std::endl;
+        std::cerr << "  --binary        length-prefixed binary frames instead of text lines" << std::endl;
+        metrics::print_usage(std::cerr);
+        return 1;
+    }
+
+    unsigned short port = static_cast<unsigned short>(std::stoi(args[0]));
+    binary_mode = args.has("binary");
+    size_t ring_size = static_cast<size_t>(std::max(2LL, args.getInt("ring-size", 4096)));
+    std::vector<int> cpus = parse_cpu_list(args.get("cpus"));
+
+    unsigned int thread_count = static_cast<unsigned int>(args.getInt("threads", 0));
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 4;
+
+    // All listeners join the SO_REUSEPORT group before any core starts accepting
+    for (unsigned int i = 0; i < thread_count; ++i)
+    {
+        cores.push_back(std::make_unique<Core>(i, thread_count, ring_size));
+        open_acceptor(cores.back()->acceptor, port);
+    }
+    std::cout << "Server listening on port " << port << "..." << std::endl;
+    std::cout << "Running " << thread_count << " core(s)" << std::endl;
+    metrics::start_reporting(args, "TCPSimpleBroadcastSO_REUSEPORTServer");
+
+    boost::asio::signal_set signals(cores[0]->ctx, SIGINT, SIGTERM);
+    signals.async_wait([](auto, auto)
+    {
+        for (auto& core : cores)
+        {
+            core->ctx.stop();
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (auto& core : cores)
+    {
+        co_spawn(core->ctx, listener(*core), detached);
+        threads.emplace_back([&core, &cpus]
+        {
+            if (!cpus.empty())
+            {
+                pin_this_thread(cpus[core->index % cpus.size()]);
+            }
+            core->ctx.run();
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    return 0;
+}
@@ -5,97 +5,364 @@
 #include <mutex>
 #include <unordered_set>
 #include <memory>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <boost/asio.hpp>
 #include <chrono>
+#include "CommandLine.hpp"
+#include "TickAggregator.hpp"
+#include "WireProtocol.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
 
 using boost::asio::ip::tcp;
 
+// One immutable copy of every broadcast payload, shared by all recipients' queues
+using SharedMessage = std::shared_ptr<const std::string>;
+
+// What to do when a client's send queue is full
+enum class OverflowPolicy { DropOldest, DropNewest, Disconnect };
+
+struct SendQueueConfig {
+    size_t limit = 1024;
+    OverflowPolicy policy = OverflowPolicy::DropOldest;
+};
+
+SendQueueConfig send_queue_config;
+std::atomic<uint64_t> dropped_messages{0};
+std::atomic<uint64_t> slow_consumer_events{0};
+
 struct Client {
     tcp::socket socket;
-    std::mutex mutex;
+    std::mutex mutex; // guards everything below
+    std::condition_variable cv;
+    std::deque<SharedMessage> outbound;
+    bool closed = false;
+    bool overflowing = false; // set while the queue is at its limit, cleared when the writer drains it
+    uint64_t dropped = 0;
+    uint64_t slow_consumer_events = 0;
     Client(boost::asio::io_context& ctx) : socket(ctx) {}
 };
 
 std::mutex clients_mutex;
 std::unordered_set<std::shared_ptr<Client>> clients;
 
-void session(std::shared_ptr<Client> client) 
+// Tick mode: lines are collected here and the ticker thread sends them once per tick
+bool tick_mode = false;
+TickAggregator tick_aggregator;
+
+// Binary mode: clients send length-prefixed wire frames instead of '\n'-terminated lines
+bool binary_mode = false;
+
+// Dedicated writer thread per client. Drains everything queued with one gathered
+// write per batch, so a slow reader only ever stalls its own writer.
+// Runs until the client is closed (by its session, or by the Disconnect overflow policy)
+// or a write fails. Either way it closes the client and shuts the socket down, which
+// wakes the reader so it removes the client. The only other thread that touches the
+// socket is a broadcaster applying the Disconnect policy, see shutdown_stalled().
+void write_loop(std::shared_ptr<Client> client)
 {
-    try 
+    std::vector<SharedMessage> batch;
+    std::vector<boost::asio::const_buffer> buffers;
+    while (true)
     {
         {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            clients.insert(client);
+            std::unique_lock<std::mutex> lock(client->mutex);
+            client->cv.wait(lock, [&] { return client->closed || !client->outbound.empty(); });
+            if (client->closed)
+            {
+                break;
+            }
+            batch.assign(std::make_move_iterator(client->outbound.begin()), std::make_move_iterator(client->outbound.end()));
+            client->outbound.clear();
+            client->overflowing = false;
         }
-        std::cout << "Client connected: " << client->socket.remote_endpoint() << std::endl;
 
-        boost::asio::streambuf buffer;
-        while (true) 
+        metrics::queued(-static_cast<int64_t>(batch.size()));
+
+        buffers.clear();
+        for (auto& msg : batch)
+        {
+            buffers.push_back(boost::asio::buffer(*msg));
+        }
+
+        boost::system::error_code ec;
+        size_t written = boost::asio::write(client->socket, buffers, ec);
+        if (ec)
         {
-            boost::system::error_code ec;
-            size_t len = boost::asio::read_until(client->socket, buffer, '\n', ec);
-            
-            if (ec) 
+            metrics::send_error();
+            break;
+        }
+        metrics::sent(written, batch.size());
+        batch.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->closed = true;
+        metrics::queued(-static_cast<int64_t>(client->outbound.size()));
+        client->outbound.clear();
+    }
+    boost::system::error_code ignored_ec;
+    client->socket.shutdown(tcp::socket::shutdown_both, ignored_ec);
+}
+
+// A queue only fills up while its writer is blocked in write() on a peer that stopped
+// reading. Shutting down the native handle fails that write and the reader's read;
+// unlike a call on the asio socket object it is safe while the client's threads use it.
+void shutdown_stalled(Client& client)
+{
+#ifdef _WIN32
+    ::shutdown(client.socket.native_handle(), SD_BOTH);
+#else
+    ::shutdown(client.socket.native_handle(), SHUT_RDWR);
+#endif
+}
+
+// Never blocks on the recipient's socket, only on its queue lock.
+void enqueue(Client& recipient, const SharedMessage& msg)
+{
+    bool disconnect = false;
+    {
+        std::lock_guard<std::mutex> lock(recipient.mutex);
+        if (recipient.closed)
+        {
+            return;
+        }
+
+        if (recipient.outbound.size() >= send_queue_config.limit)
+        {
+            if (!recipient.overflowing)
             {
-                break; 
+                recipient.overflowing = true;
+                recipient.slow_consumer_events++;
+                slow_consumer_events++;
             }
 
-            std::string msg(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + len);
-            buffer.consume(len);
-
-            if (!msg.empty()) 
+            switch (send_queue_config.policy)
             {
-                // copy current clients to avoid holding the lock during writes
-                std::vector<std::shared_ptr<Client>> current_clients;
-                {
-                    std::lock_guard<std::mutex> lock(clients_mutex);
-                    current_clients.reserve(clients.size());
-                    current_clients.insert(current_clients.end(), clients.begin(), clients.end());
-                }
-
-                auto start = std::chrono::high_resolution_clock::now();
-                for (auto& recipient : current_clients) 
-                {
-                    try 
-                    {
-                        std::lock_guard<std::mutex> lock(recipient->mutex);
-                        boost::asio::write(recipient->socket, boost::asio::buffer(msg));
-                    } 
-                    catch (...) 
-                    {
-                        // Ignore write errors; client might be disconnected
-                    }
-                }
-                auto end = std::chrono::high_resolution_clock::now();
-                std::cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+            case OverflowPolicy::DropOldest:
+                recipient.outbound.pop_front();
+                recipient.outbound.push_back(msg);
+                break;
+            case OverflowPolicy::DropNewest:
+                break;
+            case OverflowPolicy::Disconnect:
+                // The writer drops the queue once its blocked write fails
+                recipient.closed = true;
+                disconnect = true;
+                break;
             }
+            recipient.dropped++;
+            dropped_messages++;
+        }
+        else
+        {
+            recipient.outbound.push_back(msg);
+            metrics::queued(1);
+        }
+    }
+
+    if (disconnect)
+    {
+        shutdown_stalled(recipient);
+    }
+    recipient.cv.notify_one();
+}
+
+void broadcast(const SharedMessage& msg)
+{
+    // copy current clients to avoid holding the lock during writes
+    std::vector<std::shared_ptr<Client>> current_clients;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        current_clients.reserve(clients.size());
+        current_clients.insert(current_clients.end(), clients.begin(), clients.end());
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto& recipient : current_clients) 
+    {
+        enqueue(*recipient, msg);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    metrics::fanout(end - start);
+}
+
+// Sends everything aggregated during the last tick as one message per client.
+// Ticks follow a fixed schedule, so a slow tick does not shift every later one.
+void tick_loop(std::chrono::steady_clock::duration period)
+{
+    std::vector<std::string> packets;
+    auto next = std::chrono::steady_clock::now() + period;
+    while (true)
+    {
+        std::this_thread::sleep_until(next);
+        next += period;
+
+        packets.clear();
+        tick_aggregator.take(packets);
+        for (auto& packet : packets)
+        {
+            broadcast(std::make_shared<const std::string>(std::move(packet)));
+        }
+    }
+}
+
+void publish(const char* data, size_t size)
+{
+    metrics::received(size);
+    if (tick_mode)
+    {
+        tick_aggregator.add(data, size);
+    }
+    else
+    {
+        broadcast(std::make_shared<const std::string>(data, size));
+    }
+}
+
+void read_lines(Client& client)
+{
+    boost::asio::streambuf buffer;
+    while (true) 
+    {
+        boost::system::error_code ec;
+        size_t len = boost::asio::read_until(client.socket, buffer, '\n', ec);
+        
+        if (ec) 
+        {
+            break; 
+        }
+
+        if (len > 0)
+        {
+            publish(static_cast<const char*>(buffer.data().data()), len);
+        }
+        buffer.consume(len);
+    }
+}
+
+// Frames are forwarded verbatim, only the length prefix is looked at
+void read_frames(Client& client)
+{
+    wire::FrameBuffer inbound;
+    while (true)
+    {
+        boost::system::error_code ec;
+        size_t len = client.socket.read_some(boost::asio::buffer(inbound.space(), inbound.space_size()), ec);
+
+        if (ec)
+        {
+            break;
+        }
+
+        inbound.commit(len);
+        inbound.drain([](wire::MessageView frame) { publish(frame.data(), frame.length()); });
+    }
+}
+
+void session(std::shared_ptr<Client> client) 
+{
+    std::thread writer(write_loop, client);
+    try 
+    {
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients.insert(client);
+        }
+        LOG_INFO("Client connected: {}", client->socket.remote_endpoint());
+
+        if (binary_mode)
+        {
+            read_frames(*client);
+        }
+        else
+        {
+            read_lines(*client);
         }
     } 
     catch (std::exception& e) 
     {
-        std::cerr << "Exception in session: " << e.what() << std::endl;
+        LOG_WARN("Exception in session: {}", e.what());
     }
 
     {
         std::lock_guard<std::mutex> lock(clients_mutex);
         clients.erase(client);
     }
-    std::cout << "Client disconnected" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->closed = true;
+        metrics::queued(-static_cast<int64_t>(client->outbound.size()));
+        client->outbound.clear();
+    }
+    client->cv.notify_one();
+    writer.join();
+
+    LOG_INFO("Client disconnected (dropped {}, slow consumer events {}; totals: dropped {}, slow consumer events {})",
+             client->dropped, client->slow_consumer_events, dropped_messages.load(), slow_consumer_events.load());
 }
 
 int main(int argc, char* argv[]) 
 {
-    if (argc < 2) 
+    CommandLine args(argc, argv);
+    if (args.size() < 1) 
     {
-        std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <port> [--queue-limit=N] [--overflow=drop-oldest|drop-newest|disconnect] [--tick-rate=HZ] [--binary] [metrics options]" << std::endl;
+        std::cerr << "  --queue-limit=N  messages buffered per client before the overflow policy applies (default 1024)" << std::endl;
+        std::cerr << "  --overflow=...   what to do with a slow consumer's full queue (default drop-oldest)" << std::endl;
+        std::cerr << "  --tick-rate=HZ   aggregate lines and send them once per tick (default 0 = echo immediately)" << std::endl;
+        std::cerr << "  --binary         length-prefixed binary frames instead of text lines" << std::endl;
+        metrics::print_usage(std::cerr);
         return 1;
     }
 
-    unsigned short port = static_cast<unsigned short>(std::stoi(argv[1]));
+    send_queue_config.limit = static_cast<size_t>(std::max(1LL, args.getInt("queue-limit", 1024)));
+    std::string overflow = args.get("overflow", "drop-oldest");
+    if (overflow == "drop-oldest")
+    {
+        send_queue_config.policy = OverflowPolicy::DropOldest;
+    }
+    else if (overflow == "drop-newest")
+    {
+        send_queue_config.policy = OverflowPolicy::DropNewest;
+    }
+    else if (overflow == "disconnect")
+    {
+        send_queue_config.policy = OverflowPolicy::Disconnect;
+    }
+    else
+    {
+        std::cerr << "Unknown overflow policy: " << overflow << std::endl;
+        return 1;
+    }
+
+    binary_mode = args.has("binary");
+
+    unsigned short port = static_cast<unsigned short>(std::stoi(args[0]));
     boost::asio::io_context io_context;
     tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), port));
 
     std::cout << "Server listening on port " << port << "..." << std::endl;
+    metrics::start_reporting(args, "TCPSimpleBroadcastThreadPerClientServer");
+
+    double tick_rate = args.getDouble("tick-rate", 0);
+    if (tick_rate > 0)
+    {
+        tick_mode = true;
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / tick_rate));
+        std::cout << "Tick mode: " << tick_rate << " Hz" << std::endl;
+        std::thread(tick_loop, period).detach();
+    }
 
     try 
     {
@@ -108,7 +375,7 @@ int main(int argc, char* argv[])
     } 
     catch (std::exception& e) 
     {
-        std::cerr << "Server error: " << e.what() << std::endl;
+        LOG_ERROR("Server error: {}", e.what());
     }
 
     return 0;
@@ -3,11 +3,15 @@
 #include <iostream>
 #include <thread>
 #include <vector>
-#include <unordered_set>
+#include <memory>
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 #include <chrono>
+#include "CommandLine.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+#include "SnapshotRegistry.hpp"
 
 using boost::asio::awaitable;
 using boost::asio::co_spawn;
@@ -15,7 +19,20 @@ using boost::asio::detached;
 using boost::asio::use_awaitable;
 using boost::asio::io_context;
 
-static std::unordered_set<std::string> connectedClients;
+// Routing ids of every client seen so far. Copy-on-write, so the workers of --workers
+// mode read it without locking; a new id is only published once.
+static SnapshotRegistry<std::string> connectedClients;
+
+// Worker mode: the ROUTER only moves messages. A proxy thread hands every [routing id,
+// message] pair to one of the workers over inproc (the backend DEALER round-robins), and
+// each worker runs this same coroutine loop on its own io_context: it registers the
+// client, logs and fans the message out as [routing id, message] pairs, which the proxy
+// routes back out through the ROUTER. The receive, parse and fan-out work is spread over
+// the workers instead of all running on one thread.
+static const std::string backendEndpoint = "inproc://workers";
+
+// Binary mode: messages are wire frames, so they are logged by size instead of echoed as text
+static bool binaryMode = false;
 
 // RAII guard to ensure we release the FD from stream_descriptor
 // so Asio doesn't close it (it's owned by ZMQ).
@@ -29,12 +46,51 @@ struct StreamDescriptorDetacher
   }
 };
 
-void broadcastMessage(zmq::socket_t& router, const std::string& message)
+// Routing id frames of the clients in one registry snapshot, built once per snapshot
+// instead of once per send. Each message loop keeps its own: zmq_msg_copy marks its
+// source as shared, so one source must not be copied from several threads.
+struct RoutingFrames
 {
-  for (const auto& clientId : connectedClients)
+  const std::vector<std::string>* snapshot = nullptr;
+  std::vector<zmq::message_t> frames;
+
+  std::vector<zmq::message_t>& update(const std::vector<std::string>& clients)
   {
-    router.send(zmq::buffer(clientId), zmq::send_flags::sndmore);
-    router.send(zmq::buffer(message), zmq::send_flags::none);
+    // The loop's registry reader keeps the snapshot alive, so a new one has a new address
+    if (snapshot != &clients)
+    {
+      snapshot = &clients;
+      frames.clear();
+      frames.reserve(clients.size());
+      for (const auto& clientId : clients)
+      {
+        frames.emplace_back(clientId.data(), clientId.size());
+      }
+    }
+    return frames;
+  }
+};
+
+// 'router' is the ROUTER itself, or a worker's DEALER whose pairs the proxy routes out.
+// Every recipient gets a zmq_msg_copy of the received message, which shares its
+// reference-counted payload instead of copying it, so a broadcast costs no payload copies.
+void broadcastMessage(zmq::socket_t& router, std::vector<zmq::message_t>& routingIds, zmq::message_t& message)
+{
+  for (auto& routingId : routingIds)
+  {
+    zmq::message_t idFrame;
+    idFrame.copy(routingId);
+    router.send(idFrame, zmq::send_flags::sndmore);
+    zmq::message_t body;
+    body.copy(message);
+    if (auto sent = router.send(body, zmq::send_flags::none))
+    {
+      metrics::sent(*sent);
+    }
+    else
+    {
+      metrics::send_error();
+    }
   }
 }
 
@@ -66,8 +122,13 @@ awaitable<void> async_zmq_recv(zmq::socket_t& socket, boost::asio::posix::stream
   }
 }
 
+// 'router' receives and sends [routing id, message] pairs: the ROUTER itself, or in
+// worker mode a worker's DEALER on the inproc backend
 awaitable<void> messageLoop(io_context& asioCtx, zmq::socket_t& router)
 {
+  SnapshotRegistry<std::string>::Reader clients(connectedClients);
+  RoutingFrames routingFrames;
+
   // Get the ZMQ file descriptor and wrap it in an asio stream_descriptor
   int fd = router.get(zmq::sockopt::fd);
   boost::asio::posix::stream_descriptor stream_desc(asioCtx, fd);
@@ -76,16 +137,16 @@ awaitable<void> messageLoop(io_context& asioCtx, zmq::socket_t& router)
   // so Asio doesn't close it (it's owned by ZMQ).
   StreamDescriptorDetacher guard{stream_desc};
 
-  std::cout << "Server message loop started..." << std::endl;
+  LOG_INFO("Server message loop started...");
   while (true)
   {
     zmq::message_t clientId;
     co_await async_zmq_recv(router, stream_desc, clientId);
 
     std::string id(static_cast<char*>(clientId.data()), clientId.size());
-    if (connectedClients.insert(id).second)
+    if (!clients.contains(id) && connectedClients.insert(id))
     {
-      std::cout << "Client connected: " << id << std::endl;
+      LOG_INFO("Client connected: {}", id);
     }
     
     zmq::message_t message;
@@ -96,26 +157,98 @@ awaitable<void> messageLoop(io_context& asioCtx, zmq::socket_t& router)
       continue;
     }
 
-    std::string msg(static_cast<char*>(message.data()), message.size());
-    std::cout << "Received from " << id << ": " << msg << std::endl;
+    metrics::received(message.size());
+    if (binaryMode)
+    {
+      LOG_DEBUG("Received {}-byte frame from {}", message.size(), id);
+    }
+    else
+    {
+      LOG_DEBUG("Received from {}: {}", id, message.to_string_view());
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    broadcastMessage(router, routingFrames.update(clients.current()), message);
+    auto end = std::chrono::high_resolution_clock::now();
+    metrics::fanout(end - start);
+  }
+}
+
+// PUB/SUB mode: clients PUSH [topic, message] upstream and every message is published
+// once on a PUB socket. libzmq's I/O threads make the per-subscriber copies and filter by
+// topic prefix (one topic per room), so the application does one send per message
+// instead of one per client. Empty messages are forwarded too: the load test uses them
+// to find out when its subscription has reached the server.
+awaitable<void> publishLoop(io_context& asioCtx, zmq::socket_t& pull, zmq::socket_t& pub)
+{
+  int fd = pull.get(zmq::sockopt::fd);
+  boost::asio::posix::stream_descriptor stream_desc(asioCtx, fd);
+  StreamDescriptorDetacher guard{stream_desc};
+
+  LOG_INFO("Server publish loop started...");
+  while (true)
+  {
+    zmq::message_t topic;
+    co_await async_zmq_recv(pull, stream_desc, topic);
+    if (!topic.more())
+    {
+      LOG_WARN("Dropped a {}-byte message without topic frame", topic.size());
+      continue;
+    }
+
+    zmq::message_t message;
+    co_await async_zmq_recv(pull, stream_desc, message);
+    while (message.more())
+    {
+      // Only [topic, message] is published; a longer message keeps its last frame
+      co_await async_zmq_recv(pull, stream_desc, message);
+    }
+
+    metrics::received(message.size());
+    LOG_DEBUG("Received {}-byte message on topic {}", message.size(), topic.to_string());
 
     auto start = std::chrono::high_resolution_clock::now();
-    broadcastMessage(router, msg);
+    pub.send(topic, zmq::send_flags::sndmore);
+    if (auto sent = pub.send(message, zmq::send_flags::none))
+    {
+      metrics::sent(*sent);
+    }
+    else
+    {
+      metrics::send_error();
+    }
     auto end = std::chrono::high_resolution_clock::now();
-    std::cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+    metrics::fanout(end - start);
   }
 }
 
+// Unlimited inproc queues: with bounded ones the proxy could block handing a worker a
+// message while that worker blocks handing the proxy its fan-out
+void makeUnbounded(zmq::socket_t& socket)
+{
+  socket.set(zmq::sockopt::sndhwm, 0);
+  socket.set(zmq::sockopt::rcvhwm, 0);
+  socket.set(zmq::sockopt::linger, 0);
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  CommandLine args(argc, argv);
+  if (args.size() < 1)
   {
-    std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <port> [--binary] [--workers=N | --pubsub [--pub-port=P]] [--io-threads=N] [metrics options]" << std::endl;
+    std::cerr << "  --binary        clients send binary wire frames (only changes logging, messages are forwarded as-is)" << std::endl;
+    std::cerr << "  --workers=N     worker threads with their own io_context behind an inproc proxy (default 0 = everything on one thread, -1 = hardware concurrency)" << std::endl;
+    std::cerr << "  --pubsub        clients PUSH [topic, message] to <port>, every message is published once on a PUB socket (TCPZeroMQLoadTest --pubsub)" << std::endl;
+    std::cerr << "  --pub-port=P    PUB socket port in --pubsub mode (default <port> + 1)" << std::endl;
+    std::cerr << "  --io-threads=N  ZeroMQ I/O threads, ZMQ_IO_THREADS (default 1)" << std::endl;
+    metrics::print_usage(std::cerr);
     return 1;
   }
+  binaryMode = args.has("binary");
 
   io_context ctx;
-  std::string arg = argv[1];
+  std::string arg = args[0];
   size_t pos;
   unsigned short port = static_cast<unsigned short>(std::stoi(arg, &pos));
 
@@ -125,15 +258,95 @@ int main(int argc, char* argv[])
   unsigned short port_copy = port;
   std::string endpoint = "tcp://*:" + std::to_string(port_copy);
 
+  int ioThreads = static_cast<int>(std::max(1LL, args.getInt("io-threads", 1)));
+  long long workers = args.getInt("workers", 0);
+  if (workers < 0)
+  {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  if (args.has("pubsub") && workers != 0)
+  {
+    std::cerr << "--pubsub cannot be combined with --workers" << std::endl;
+    return 1;
+  }
+
+  zmq::context_t zmqCtx(ioThreads);
+  if (args.has("pubsub"))
+  {
+    unsigned short pubPort = static_cast<unsigned short>(args.getInt("pub-port", port + 1));
+    zmq::socket_t pull(zmqCtx, zmq::socket_type::pull);
+    pull.set(zmq::sockopt::linger, 0);
+    pull.bind(endpoint);
+    zmq::socket_t pub(zmqCtx, zmq::socket_type::pub);
+    pub.set(zmq::sockopt::linger, 0);
+    pub.bind("tcp://*:" + std::to_string(pubPort));
+    std::cout << "Server listening on port " << port << ", publishing on port " << pubPort << "..." << std::endl;
+    std::cout << "ZeroMQ I/O threads: " << ioThreads << std::endl;
+    metrics::start_reporting(args, "TCPZeroMQBroadcastServer");
+
+    co_spawn(ctx, publishLoop(ctx, pull, pub), detached);
+    ctx.run();
+    return 0;
+  }
+
   // prepare zmq router
-  zmq::context_t zmqCtx(1);
   zmq::socket_t router(zmqCtx, zmq::socket_type::router);
+  router.set(zmq::sockopt::linger, 0);
   router.bind(endpoint);
   std::cout << "Server listening on port " << port << "..." << std::endl;
+  std::cout << "ZeroMQ I/O threads: " << ioThreads << std::endl;
+  metrics::start_reporting(args, "TCPZeroMQBroadcastServer");
 
-  co_spawn(ctx, messageLoop(ctx, router), detached);
+  if (workers == 0)
+  {
+    co_spawn(ctx, messageLoop(ctx, router), detached);
+    ctx.run();
+    return 0;
+  }
+
+  zmq::socket_t backend(zmqCtx, zmq::socket_type::dealer);
+  makeUnbounded(backend);
+  backend.bind(backendEndpoint);
+  std::cout << "Workers: " << workers << std::endl;
+
+  // Declared before their io_contexts, so the sockets outlive the coroutines that wait on them
+  std::vector<std::unique_ptr<zmq::socket_t>> workerSockets;
+  std::vector<std::unique_ptr<io_context>> workerContexts;
+  std::vector<std::thread> threads;
+  for (long long i = 0; i < workers; ++i)
+  {
+    workerSockets.push_back(std::make_unique<zmq::socket_t>(zmqCtx, zmq::socket_type::dealer));
+    makeUnbounded(*workerSockets.back());
+    workerSockets.back()->connect(backendEndpoint);
+    workerContexts.push_back(std::make_unique<io_context>(1));
+    co_spawn(*workerContexts.back(), messageLoop(*workerContexts.back(), *workerSockets.back()), detached);
+    threads.emplace_back([workerCtx = workerContexts.back().get()] { workerCtx->run(); });
+  }
+  std::thread proxy([&]
+  {
+    try
+    {
+      zmq::proxy(router, backend);
+    }
+    catch (const zmq::error_t&)
+    {
+      // context shut down
+    }
+  });
 
+  // The main thread only waits for the signal, then stops the workers and the proxy
   ctx.run();
+  for (auto& workerCtx : workerContexts)
+  {
+    workerCtx->stop();
+  }
+  zmqCtx.shutdown();
+  proxy.join();
+  for (auto& t : threads)
+  {
+    t.join();
+  }
 
   return 0;
 }
\ No newline at end of file
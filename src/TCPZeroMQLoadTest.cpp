@@ -9,13 +9,259 @@
 #include <algorithm>
 #include <numeric>
 #include <latch>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include "CommandLine.hpp"
+#include "WireProtocol.hpp"
+#include "LatencyHistogram.hpp"
 
+// Each client records into its own histogram without locking and merges it here once at the end
 std::mutex latencies_mutex;
-std::vector<long long> latencies;
+LatencyHistogram latencies;
+
+// Binary mode: send and match one wire frame per ZMQ message instead of text
+bool binary_mode = false;
+
+// PUB/SUB mode: clients PUSH [topic, message] to the server and SUBscribe to their room's
+// topic on its PUB port, so they only receive their room's messages
+bool pubsub_mode = false;
+std::string pub_port;
+int rooms = 1;
+
+std::string room_topic(int id)
+{
+  // Terminated, so "room1/" is not a prefix of "room10/"
+  return "room" + std::to_string(id % rooms) + "/";
+}
+
+long long now_us()
+{
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+// Create message with timestamp (compatible with the format used in ZeroMQClient.cpp)
+std::string make_payload(int id)
+{
+  long long timestamp = now_us();
+  return binary_mode
+    ? wire::encode(wire::MessageType::Broadcast, static_cast<uint32_t>(id), 0, timestamp)
+    : std::to_string(timestamp) + "|Load Test Message from " + std::to_string(id);
+}
+
+// Records the RTT if the reply is this client's own message. Returns true if it was.
+bool record_reply(const zmq::message_t& reply, int id, LatencyHistogram& histogram)
+{
+  if (binary_mode)
+  {
+    // ZMQ keeps message boundaries, so each message is exactly one frame, read in place
+    const char* data = static_cast<const char*>(reply.data());
+    if (reply.size() >= wire::header_size && wire::frame_length(data, reply.size()) == reply.size())
+    {
+      wire::MessageView frame(data);
+      if (frame.sender() == static_cast<uint32_t>(id))
+      {
+        histogram.record(now_us() - frame.timestamp());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::string msg(static_cast<const char*>(reply.data()), reply.size());
+  std::string suffix = "|Load Test Message from " + std::to_string(id);
+  if (msg.find(suffix) == std::string::npos)
+  {
+    return false;
+  }
+  size_t delimiterPos = msg.find('|');
+  try
+  {
+    long long sent_ts = std::stoll(msg.substr(0, delimiterPos));
+    // save latency data for this client
+    histogram.record(now_us() - sent_ts);
+    return true;
+  }
+  catch (...)
+  {
+    return false;
+  }
+}
+
+// Publishes empty messages on a topic only this client subscribed to until one comes back,
+// so its subscriptions are known to have reached the server before the run starts
+void await_subscription(zmq::socket_t& push, zmq::socket_t& sub, int id)
+{
+  std::string sync_topic = "sync" + std::to_string(id) + "/";
+  sub.set(zmq::sockopt::subscribe, sync_topic);
+  sub.set(zmq::sockopt::rcvtimeo, 100);
+  for (int attempt = 0; attempt < 100; ++attempt)
+  {
+    push.send(zmq::buffer(sync_topic), zmq::send_flags::sndmore);
+    push.send(zmq::message_t(), zmq::send_flags::none);
+
+    zmq::message_t topic;
+    while (sub.recv(topic, zmq::recv_flags::none))
+    {
+      zmq::message_t ignored;
+      while (topic.more() && sub.recv(ignored, zmq::recv_flags::none) && ignored.more())
+      {
+      }
+      if (topic.to_string_view() == sync_topic)
+      {
+        sub.set(zmq::sockopt::unsubscribe, sync_topic);
+        return;
+      }
+    }
+  }
+  throw std::runtime_error("subscription did not reach the server");
+}
+
+void run_pubsub_client(int id, const std::string& host, const std::string& port, std::latch& start_latch)
+{
+  LatencyHistogram histogram;
+  bool connected = false;
+  try
+  {
+    // Create a dedicated context per thread to simulate distinct clients/processes
+    zmq::context_t context(1);
+    zmq::socket_t push(context, zmq::socket_type::push);
+    zmq::socket_t sub(context, zmq::socket_type::sub);
+    push.set(zmq::sockopt::linger, 0);
+    sub.set(zmq::sockopt::linger, 0);
+    push.connect("tcp://" + host + ":" + port);
+    sub.connect("tcp://" + host + ":" + pub_port);
+    std::string topic = room_topic(id);
+    sub.set(zmq::sockopt::subscribe, topic);
+    await_subscription(push, sub, id);
+
+    // wait until all clients are subscribed before sending messages
+    start_latch.arrive_and_wait();
+    connected = true;
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::string payload = make_payload(id);
+    push.send(zmq::buffer(topic), zmq::send_flags::sndmore);
+    push.send(zmq::buffer(payload), zmq::send_flags::none);
+
+    // keep listening for up to 10 seconds to receive as many published messages as possible
+    bool foundMyMessage = false;
+    sub.set(zmq::sockopt::rcvtimeo, 100);
+    while (std::chrono::steady_clock::now() - start_time < std::chrono::seconds(10))
+    {
+      zmq::message_t received_topic;
+      if (!sub.recv(received_topic, zmq::recv_flags::none) || !received_topic.more())
+      {
+        continue;
+      }
+      zmq::message_t reply;
+      if (sub.recv(reply, zmq::recv_flags::none) && !foundMyMessage && reply.size() > 0)
+      {
+        foundMyMessage = record_reply(reply, id, histogram);
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    if (!connected)
+    {
+      start_latch.count_down();
+    }
+    std::cerr << "Client " << id << " error: " << e.what() << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(latencies_mutex);
+  latencies.merge(histogram);
+}
+
+// Multiplexed mode: all clients are DEALERs in one shared context with a few I/O threads,
+// and a small pool of threads each waits on its share of the sockets with zmq::poll,
+// instead of one context and one blocked thread per client
+void run_poll_thread(zmq::context_t& context, std::vector<int> ids, const std::string& host, const std::string& port, std::latch& start_latch)
+{
+  LatencyHistogram histogram;
+  std::vector<zmq::socket_t> sockets;
+  bool connected = false;
+  try
+  {
+    std::string endpoint = "tcp://" + host + ":" + port;
+    sockets.reserve(ids.size());
+    for (int id : ids)
+    {
+      zmq::socket_t& socket = sockets.emplace_back(context, zmq::socket_type::dealer);
+      socket.set(zmq::sockopt::routing_id, "load_client_" + std::to_string(id));
+      socket.set(zmq::sockopt::probe_router, 1);
+      socket.set(zmq::sockopt::linger, 0);
+      socket.connect(endpoint);
+    }
+
+    // wait until all clients are connected before sending messages
+    start_latch.arrive_and_wait();
+    connected = true;
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sockets.size(); ++i)
+    {
+      std::string payload = make_payload(ids[i]);
+      sockets[i].send(zmq::buffer(payload), zmq::send_flags::none);
+    }
+
+    std::vector<zmq::pollitem_t> items;
+    for (auto& socket : sockets)
+    {
+      items.push_back({socket.handle(), 0, ZMQ_POLLIN, 0});
+    }
+    std::vector<bool> foundMyMessage(sockets.size(), false);
+
+    // keep listening for up to 10 seconds to receive as many broadcasted messages as possible
+    while (true)
+    {
+      auto remaining = std::chrono::seconds(10) - (std::chrono::steady_clock::now() - start_time);
+      if (remaining <= std::chrono::steady_clock::duration::zero())
+      {
+        break;
+      }
+      auto timeout = std::min(std::chrono::duration_cast<std::chrono::milliseconds>(remaining), std::chrono::milliseconds(100));
+      if (zmq::poll(items.data(), items.size(), timeout) <= 0)
+      {
+        continue;
+      }
+
+      for (size_t i = 0; i < items.size(); ++i)
+      {
+        if (!(items[i].revents & ZMQ_POLLIN))
+        {
+          continue;
+        }
+        // Drain everything queued on this socket before polling again
+        zmq::message_t reply;
+        while (sockets[i].recv(reply, zmq::recv_flags::dontwait))
+        {
+          if (!foundMyMessage[i])
+          {
+            foundMyMessage[i] = record_reply(reply, ids[i], histogram);
+          }
+        }
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    if (!connected)
+    {
+      start_latch.count_down();
+    }
+    std::cerr << "Poll thread error: " << e.what() << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(latencies_mutex);
+  latencies.merge(histogram);
+}
 
 void run_client(int id, const std::string& host, const std::string& port, std::latch& start_latch)
 {
+  LatencyHistogram histogram;
   bool connected = false;
   try 
   {
@@ -37,10 +283,7 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
 
     auto start_time = std::chrono::steady_clock::now();
 
-    // Create message with timestamp (compatible with the format used in ZeroMQClient.cpp)
-    auto now = std::chrono::high_resolution_clock::now();
-    auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-    std::string payload = std::to_string(timestamp) + "|Load Test Message from " + std::to_string(id);
+    std::string payload = make_payload(id);
 
     // Send message
     socket.send(zmq::buffer(payload), zmq::send_flags::none);
@@ -66,34 +309,9 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
       zmq::message_t reply;
       auto res = socket.recv(reply, zmq::recv_flags::none);
 
-      if (res)
+      if (res && !foundMyMessage)
       {
-        std::string msg(static_cast<char*>(reply.data()), reply.size());
-        std::string suffix = "|Load Test Message from " + std::to_string(id);
-        if (msg.find(suffix) != std::string::npos)
-        {
-          if (!foundMyMessage)
-          {
-            auto now_recv = std::chrono::high_resolution_clock::now();
-            auto current = std::chrono::duration_cast<std::chrono::microseconds>(now_recv.time_since_epoch()).count();
-            size_t delimiterPos = msg.find('|');
-            if (delimiterPos != std::string::npos)
-            {
-              try 
-              {
-                long long sent_ts = std::stoll(msg.substr(0, delimiterPos));
-                long long rtt = current - sent_ts;
-                std::lock_guard<std::mutex> lock(latencies_mutex);
-                // save latency data for this client
-                latencies.push_back(rtt);
-                foundMyMessage = true;
-              } 
-              catch (...) 
-              {
-              }
-            }
-          }
-        }
+        foundMyMessage = record_reply(reply, id, histogram);
       }
     }
   }
@@ -105,52 +323,115 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
     }
     std::cerr << "Client " << id << " error: " << e.what() << std::endl;
   }
+
+  std::lock_guard<std::mutex> lock(latencies_mutex);
+  latencies.merge(histogram);
 }
 
 int main(int argc, char* argv[]) 
 {
-  if (argc < 4) 
+  CommandLine args(argc, argv);
+  if (args.size() < 3) 
   {
-    std::cerr << "Usage: " << argv[0] << " <host> <port> <clients>" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <host> <port> <clients> [--binary] [--histogram[=FILE]] [--pubsub [--pub-port=P] [--rooms=N]] [--multiplexed [--poll-threads=N] [--io-threads=N]]" << std::endl;
+    std::cerr << "  --binary            binary wire frames instead of text messages" << std::endl;
+    std::cerr << "  --histogram[=FILE]  also print the full latency distribution (to FILE if given)" << std::endl;
+    std::cerr << "  --pubsub            PUSH to <port> and subscribe on the PUB port (server --pubsub)" << std::endl;
+    std::cerr << "  --pub-port=P        server PUB port (default <port> + 1)" << std::endl;
+    std::cerr << "  --rooms=N           spread the clients over N rooms, one topic each (default 1)" << std::endl;
+    std::cerr << "  --multiplexed       one shared context, clients polled by a few threads instead of a thread and context each (raise ulimit -n for many clients)" << std::endl;
+    std::cerr << "  --poll-threads=N    threads polling the client sockets in multiplexed mode (default 1, 0 = hardware concurrency)" << std::endl;
+    std::cerr << "  --io-threads=N      ZeroMQ I/O threads of the shared context in multiplexed mode (default 1)" << std::endl;
     return 1;
   }
 
-  std::string host = argv[1];
-  std::string port = argv[2];
-  int num_clients = std::stoi(argv[3]);
+  std::string host = args[0];
+  std::string port = args[1];
+  int num_clients = std::stoi(args[2]);
+  binary_mode = args.has("binary");
+  pubsub_mode = args.has("pubsub");
+  pub_port = args.get("pub-port", std::to_string(std::stoi(port) + 1));
+  rooms = static_cast<int>(std::max(1LL, args.getInt("rooms", 1)));
+  bool multiplexed = args.has("multiplexed");
+  if (multiplexed && pubsub_mode)
+  {
+    std::cerr << "--multiplexed cannot be combined with --pubsub" << std::endl;
+    return 1;
+  }
 
   std::cout << "Spawning " << num_clients << " clients connecting to " << host << ":" << port << "..." << std::endl;
   std::vector<std::thread> threads;
   threads.reserve(num_clients);
 
   auto start = std::chrono::high_resolution_clock::now();
-  std::latch start_latch(num_clients);
-
-  for (int i = 0; i < num_clients; ++i) 
+  std::unique_ptr<zmq::context_t> shared_context;
+  if (multiplexed)
   {
-    threads.emplace_back(run_client, i, host, port, std::ref(start_latch));
-  }
+    size_t poll_threads = static_cast<size_t>(std::max(0LL, args.getInt("poll-threads", 1)));
+    if (poll_threads == 0) poll_threads = std::max(1u, std::thread::hardware_concurrency());
+    poll_threads = std::min(poll_threads, static_cast<size_t>(std::max(num_clients, 1)));
+    int io_threads = static_cast<int>(std::max(1LL, args.getInt("io-threads", 1)));
+    // The default limit of 1023 sockets per context would cap the client count
+    shared_context = std::make_unique<zmq::context_t>(io_threads, num_clients + 16);
+    std::cout << "Multiplexed mode: " << poll_threads << " poll thread(s), " << io_threads << " ZeroMQ I/O thread(s)" << std::endl;
 
-  for (auto& t : threads) 
-  {
-    if (t.joinable())
+    // Clients are spread round-robin over the poll threads
+    std::vector<std::vector<int>> ids(poll_threads);
+    for (int i = 0; i < num_clients; ++i)
+    {
+      ids[static_cast<size_t>(i) % poll_threads].push_back(i);
+    }
+    std::latch start_latch(static_cast<std::ptrdiff_t>(poll_threads));
+    for (auto& thread_ids : ids)
+    {
+      threads.emplace_back(run_poll_thread, std::ref(*shared_context), std::move(thread_ids), host, port, std::ref(start_latch));
+    }
+    for (auto& t : threads)
     {
       t.join();
     }
   }
+  else
+  {
+    std::latch start_latch(num_clients);
+
+    for (int i = 0; i < num_clients; ++i) 
+    {
+      threads.emplace_back(pubsub_mode ? run_pubsub_client : run_client, i, host, port, std::ref(start_latch));
+    }
+
+    for (auto& t : threads) 
+    {
+      if (t.joinable())
+      {
+        t.join();
+      }
+    }
+  }
 
   auto end = std::chrono::high_resolution_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 
   std::cout << "Finished " << num_clients << " clients in " << duration << "ms" << std::endl;
 
-  if (!latencies.empty())
+  if (latencies.count() > 0)
+  {
+    latencies.print_summary(std::cout);
+  }
+
+  // --histogram prints the full distribution, --histogram=FILE writes it to a file
+  if (args.has("histogram"))
   {
-    long long min_val = *std::min_element(latencies.begin(), latencies.end());
-    long long max_val = *std::max_element(latencies.begin(), latencies.end());
-    long long sum = std::accumulate(latencies.begin(), latencies.end(), 0LL);
-    double avg = static_cast<double>(sum) / latencies.size();
-    std::cout << "Latency (us) -> Min: " << min_val << ", Max: " << max_val << ", Avg: " << avg << std::endl;
+    std::string path = args.get("histogram");
+    if (path.empty())
+    {
+      latencies.print_distribution(std::cout);
+    }
+    else
+    {
+      std::ofstream file(path);
+      latencies.print_distribution(file);
+    }
   }
 
   return 0;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <limits>
+
+// Collects the messages received during one tick so they can be sent as one
+// aggregated packet per client when the tick ends, which turns N immediate
+// N-recipient broadcasts into a single N-recipient send per tick.
+//
+// Messages are joined with 'separator'. A packet is closed before it would grow
+// past max_packet_size, so UDP payloads stay within the clients' receive buffers;
+// TCP callers leave the limit unbounded and get exactly one packet per tick.
+class TickAggregator
+{
+public:
+    explicit TickAggregator(size_t max_packet_size = std::numeric_limits<size_t>::max(), std::string separator = "")
+        : max_packet_size(max_packet_size), separator(std::move(separator))
+    {
+    }
+
+    void add(const char* data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!current.empty() && current.size() + separator.size() + size > max_packet_size)
+        {
+            packets.push_back(std::move(current));
+            current.clear();
+        }
+        if (!current.empty())
+        {
+            current += separator;
+        }
+        current.append(data, size);
+        messages++;
+    }
+
+    // Appends everything collected since the last call to 'out' and starts a new tick.
+    // Returns the number of messages taken.
+    size_t take(std::vector<std::string>& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!current.empty())
+        {
+            packets.push_back(std::move(current));
+            current.clear();
+        }
+        for (auto& packet : packets)
+        {
+            out.push_back(std::move(packet));
+        }
+        packets.clear();
+
+        size_t taken = messages;
+        messages = 0;
+        return taken;
+    }
+
+private:
+    size_t max_packet_size;
+    std::string separator;
+    std::mutex mutex;
+    std::string current;
+    std::vector<std::string> packets;
+    size_t messages = 0;
+};
\ No newline at end of file
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <boost/asio.hpp>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#define UDP_BATCH_SUPPORTED 1
+#endif
+
+// Sends payloads to many endpoints with as few syscalls as possible.
+// On Linux every (endpoint, payload) pair becomes one mmsghdr entry pointing at
+// the shared iovec of that payload, and up to batch_size entries are flushed with
+// one sendmmsg each. Elsewhere it falls back to one send_to per datagram.
+class SendBatch
+{
+public:
+    // sendmmsg caps vlen at UIO_MAXIOV
+    static constexpr size_t max_batch_size = 1024;
+
+    explicit SendBatch(size_t batch_size)
+        : batch_size(std::clamp<size_t>(batch_size, 1, max_batch_size))
+    {
+#ifdef UDP_BATCH_SUPPORTED
+        headers.resize(this->batch_size);
+#endif
+    }
+
+    size_t size() const
+    {
+        return batch_size;
+    }
+
+    // Returns the number of send syscalls issued. Per-endpoint failures are skipped and counted.
+    template <typename Endpoints>
+    size_t send(boost::asio::ip::udp::socket& socket, const void* data, size_t length, const Endpoints& endpoints)
+    {
+        boost::asio::const_buffer payload(data, length);
+        return send(socket, &payload, 1, endpoints);
+    }
+
+    // Sends every payload to every endpoint, endpoint-major so each client sees the payloads in order.
+    template <typename Endpoints>
+    size_t send(boost::asio::ip::udp::socket& socket, const boost::asio::const_buffer* payloads, size_t payload_count, const Endpoints& endpoints)
+    {
+        size_t syscalls = 0;
+#ifdef UDP_BATCH_SUPPORTED
+        iovecs.resize(payload_count);
+        for (size_t i = 0; i < payload_count; ++i)
+        {
+            iovecs[i].iov_base = const_cast<void*>(payloads[i].data());
+            iovecs[i].iov_len = payloads[i].size();
+        }
+
+        size_t count = 0;
+        for (const auto& ep : endpoints)
+        {
+            for (size_t i = 0; i < payload_count; ++i)
+            {
+                msghdr& hdr = headers[count].msg_hdr;
+                hdr = msghdr{};
+                hdr.msg_name = const_cast<sockaddr*>(ep.data());
+                hdr.msg_namelen = static_cast<socklen_t>(ep.size());
+                hdr.msg_iov = &iovecs[i];
+                hdr.msg_iovlen = 1;
+
+                if (++count == batch_size)
+                {
+                    syscalls += flush(socket, count);
+                    count = 0;
+                }
+            }
+        }
+        syscalls += flush(socket, count);
+#else
+        for (const auto& ep : endpoints)
+        {
+            for (size_t i = 0; i < payload_count; ++i)
+            {
+                boost::system::error_code ec;
+                socket.send_to(payloads[i], ep, 0, ec);
+                syscalls++;
+                if (ec)
+                {
+                    failed++;
+                }
+            }
+        }
+#endif
+        return syscalls;
+    }
+
+    // Datagrams that failed to send since the last call
+    size_t take_failures()
+    {
+        return std::exchange(failed, 0);
+    }
+
+private:
+#ifdef UDP_BATCH_SUPPORTED
+    size_t flush(boost::asio::ip::udp::socket& socket, size_t count)
+    {
+        size_t syscalls = 0;
+        size_t sent = 0;
+        while (sent < count)
+        {
+            int result = ::sendmmsg(socket.native_handle(), &headers[sent], static_cast<unsigned int>(count - sent), 0);
+            syscalls++;
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // The first entry failed (e.g. unreachable peer); skip it and go on
+                sent++;
+                failed++;
+            }
+            else
+            {
+                sent += static_cast<size_t>(std::max(result, 1));
+            }
+        }
+        return syscalls;
+    }
+
+    std::vector<mmsghdr> headers;
+    std::vector<iovec> iovecs;
+#endif
+    size_t batch_size;
+    size_t failed = 0;
+};
+
+// Drains up to batch_size datagrams per wakeup into a preallocated slab.
+// On Linux this is a single recvmmsg, elsewhere one receive_from per call.
+class ReceiveBatch
+{
+public:
+    static constexpr size_t max_batch_size = 1024;
+
+    explicit ReceiveBatch(size_t batch_size, size_t datagram_size = 1024)
+        : batch_size(std::clamp<size_t>(batch_size, 1, max_batch_size)),
+          datagram_size(datagram_size),
+          slab(this->batch_size * datagram_size),
+          lengths(this->batch_size),
+          senders(this->batch_size)
+    {
+#ifdef UDP_BATCH_SUPPORTED
+        headers.resize(this->batch_size);
+        iovecs.resize(this->batch_size);
+        addresses.resize(this->batch_size);
+        for (size_t i = 0; i < this->batch_size; ++i)
+        {
+            iovecs[i].iov_base = slab.data() + i * datagram_size;
+            iovecs[i].iov_len = datagram_size;
+        }
+#endif
+    }
+
+    size_t size() const
+    {
+        return batch_size;
+    }
+
+    // Number of datagrams held from the last receive call
+    size_t count() const
+    {
+        return received;
+    }
+
+    boost::asio::const_buffer data(size_t index) const
+    {
+        return boost::asio::const_buffer(slab.data() + index * datagram_size, lengths[index]);
+    }
+
+    const boost::asio::ip::udp::endpoint& sender(size_t index) const
+    {
+        return senders[index];
+    }
+
+    // Blocks until at least one datagram arrives, then takes whatever else is already queued.
+    // Throws boost::system::system_error like udp::socket::receive_from.
+    size_t receive(boost::asio::ip::udp::socket& socket)
+    {
+#ifdef UDP_BATCH_SUPPORTED
+        boost::system::error_code ec;
+        receive(socket, MSG_WAITFORONE, ec);
+        if (ec)
+        {
+            throw boost::system::system_error(ec);
+        }
+#else
+        lengths[0] = socket.receive_from(boost::asio::buffer(slab.data(), datagram_size), senders[0]);
+        received = 1;
+#endif
+        return received;
+    }
+
+    // Only takes what is already queued and never blocks; returns 0 once the socket is drained.
+    size_t try_receive(boost::asio::ip::udp::socket& socket)
+    {
+        boost::system::error_code ec;
+#ifdef UDP_BATCH_SUPPORTED
+        receive(socket, MSG_DONTWAIT, ec);
+#else
+        socket.non_blocking(true);
+        received = 0;
+        lengths[0] = socket.receive_from(boost::asio::buffer(slab.data(), datagram_size), senders[0], 0, ec);
+        if (!ec)
+        {
+            received = 1;
+        }
+#endif
+        if (ec && ec != boost::asio::error::would_block && ec != boost::asio::error::try_again)
+        {
+            throw boost::system::system_error(ec);
+        }
+        return received;
+    }
+
+private:
+#ifdef UDP_BATCH_SUPPORTED
+    void receive(boost::asio::ip::udp::socket& socket, int flags, boost::system::error_code& ec)
+    {
+        received = 0;
+        for (size_t i = 0; i < batch_size; ++i)
+        {
+            msghdr& hdr = headers[i].msg_hdr;
+            hdr = msghdr{};
+            hdr.msg_name = &addresses[i];
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_iov = &iovecs[i];
+            hdr.msg_iovlen = 1;
+            headers[i].msg_len = 0;
+        }
+
+        int result;
+        do
+        {
+            result = ::recvmmsg(socket.native_handle(), headers.data(), static_cast<unsigned int>(batch_size), flags, nullptr);
+        } while (result < 0 && errno == EINTR);
+
+        if (result < 0)
+        {
+            ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+            return;
+        }
+
+        received = static_cast<size_t>(result);
+        for (size_t i = 0; i < received; ++i)
+        {
+            lengths[i] = headers[i].msg_len;
+            senders[i].resize(headers[i].msg_hdr.msg_namelen);
+            std::memcpy(senders[i].data(), &addresses[i], headers[i].msg_hdr.msg_namelen);
+        }
+    }
+
+    std::vector<mmsghdr> headers;
+    std::vector<iovec> iovecs;
+    std::vector<sockaddr_storage> addresses;
+#endif
+    size_t batch_size;
+    size_t datagram_size;
+    std::vector<char> slab;
+    std::vector<size_t> lengths;
+    std::vector<boost::asio::ip::udp::endpoint> senders;
+    size_t received = 0;
+};
\ No newline at end of file
@@ -5,7 +5,16 @@
 #include <boost/asio.hpp>
 #include <boost/asio/io_context.hpp>
 #include <set>
+#include <map>
 #include <chrono>
+#include "CommandLine.hpp"
+#include "UDPBatch.hpp"
+#include "TickAggregator.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+#include "DeltaSnapshots.hpp"
+#include "ReliableUdp.hpp"
+#include "SessionTable.hpp"
 
 using boost::asio::awaitable;
 using boost::asio::co_spawn;
@@ -17,59 +26,419 @@ using namespace std;
 
 static set<udp::endpoint> connectedEndpoints;
 
-awaitable<void> listener(io_context& ctx, unsigned short port)
+// Tick mode: messages are collected here and sent once per tick instead of echoed right away
+static bool tickMode = false;
+// Text messages are joined with '\n'; binary wire frames are self-delimiting and need no separator
+static std::unique_ptr<TickAggregator> tickAggregator;
+
+// Delta mode: frames update the senders' entity states and every tick each client gets
+// the changes since the last snapshot it acknowledged, instead of the aggregated frames
+static std::unique_ptr<delta::SnapshotHistory<udp::endpoint>> snapshotHistory;
+
+// Reliable mode: every client datagram is a reliability layer packet. Delivered messages
+// go to every client on the channel they came in on, and a flusher resends what is
+// still unacknowledged and sends acknowledgements that had nothing to ride along with.
+static bool reliableMode = false;
+static map<udp::endpoint, reliable::Connection> connections;
+static std::chrono::steady_clock::duration flushInterval = std::chrono::milliseconds(10);
+
+// Session mode: clients connect with a handshake and stamp their session id into every
+// frame; datagrams without a valid one are answered with an Accept and dropped, and
+// sessions silent for the idle timeout are evicted
+static std::unique_ptr<SessionTable> sessions;
+
+long long nowMicros()
 {
-  udp::socket socket(ctx, { udp::v4(), port });
-  cout << "Server listening on port " << port << "..." << endl;
-  char data[1024];
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// Sends every packet the connection has ready. Returns the number sent.
+awaitable<size_t> flushConnection(udp::socket& socket, const udp::endpoint& peer, reliable::Connection& connection)
+{
+  size_t packets = 0;
+  string packet;
+  while (connection.write_packet(packet, nowMicros()))
+  {
+    packets++;
+    try
+    {
+      metrics::sent(co_await socket.async_send_to(boost::asio::buffer(packet), peer, use_awaitable));
+    }
+    catch (const std::exception& e)
+    {
+      LOG_WARN("Write error: {}", e.what());
+      metrics::send_error();
+    }
+  }
+  co_return packets;
+}
+
+// Entries are never erased, so iterators stay valid across the suspensions
+awaitable<void> flushAll(udp::socket& socket)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t packets = 0;
+  for (auto& [peer, connection] : connections)
+  {
+    packets += co_await flushConnection(socket, peer, connection);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  if (packets > 0)
+  {
+    metrics::fanout(end - start);
+  }
+}
+
+void receiveReliable(const udp::endpoint& sender, const char* data, size_t size)
+{
+  reliable::Connection& connection = connections[sender];
+  try
+  {
+    wire::for_each_frame(data, size, [&](wire::MessageView packet)
+    {
+      connection.receive(packet, nowMicros(), [](reliable::Channel channel, const char* message, size_t length)
+      {
+        for (auto& [peer, recipient] : connections)
+        {
+          recipient.send(channel, message, length);
+        }
+      });
+    });
+  }
+  catch (const std::exception& e)
+  {
+    LOG_WARN("Malformed packet from {}: {}", sender, e.what());
+  }
+}
+
+awaitable<void> flusher(udp::socket& socket)
+{
+  boost::asio::steady_timer timer(socket.get_executor());
+  while (true)
+  {
+    timer.expires_after(flushInterval);
+    co_await timer.async_wait(use_awaitable);
+    co_await flushAll(socket);
+  }
+}
+
+// Handles the session protocol for one datagram. True if it is to be handled as usual.
+awaitable<bool> admit(udp::socket& socket, const udp::endpoint& sender, const char* data, size_t size)
+{
+  string reply;
+  bool opened = false;
+  if (sessions->admit(sender, data, size, reply, opened))
+  {
+    co_return true;
+  }
+  if (opened)
+  {
+    connectedEndpoints.insert(sender);
+    LOG_INFO("Client connected: {} session {}", sender, wire::MessageView(reply.data()).session());
+  }
+  try
+  {
+    metrics::sent(co_await socket.async_send_to(boost::asio::buffer(reply), sender, use_awaitable));
+  }
+  catch (const std::exception& e)
+  {
+    LOG_WARN("Write error: {}", e.what());
+    metrics::send_error();
+  }
+  co_return false;
+}
+
+awaitable<void> reaper(udp::socket& socket)
+{
+  boost::asio::steady_timer timer(socket.get_executor());
+  while (true)
+  {
+    timer.expires_after(sessions->tick_length());
+    co_await timer.async_wait(use_awaitable);
+    sessions->expire(std::chrono::steady_clock::now(), [](const udp::endpoint& endpoint, uint32_t client)
+    {
+      connectedEndpoints.erase(endpoint);
+      if (snapshotHistory)
+      {
+        snapshotHistory->forget(endpoint);
+        snapshotHistory->remove(client);
+      }
+      LOG_INFO("Client timed out: {}", endpoint);
+    });
+  }
+}
+
+awaitable<void> listener(udp::socket& socket, size_t batch_size)
+{
+  ReceiveBatch received(batch_size);
+  vector<bool> admitted;
+  vector<udp::endpoint> recipients;
   while (true)
   {
-    udp::endpoint sender_endpoint;
-    size_t length = co_await socket.async_receive_from(boost::asio::buffer(data), sender_endpoint, use_awaitable);
+    // Wait for readiness, then drain everything already queued in one recvmmsg
+    co_await socket.async_wait(udp::socket::wait_read, use_awaitable);
+    size_t count = received.try_receive(socket);
 
-    if (connectedEndpoints.find(sender_endpoint) == connectedEndpoints.end())
+    admitted.assign(count, true);
+    for (size_t i = 0; i < count; ++i)
     {
-      connectedEndpoints.insert(sender_endpoint);
-      cout << "Client connected: " << sender_endpoint << '\n';
+      metrics::received(received.data(i).size());
+      const udp::endpoint& sender_endpoint = received.sender(i);
+      if (sessions)
+      {
+        admitted[i] = co_await admit(socket, sender_endpoint, static_cast<const char*>(received.data(i).data()), received.data(i).size());
+      }
+      else if (connectedEndpoints.find(sender_endpoint) == connectedEndpoints.end())
+      {
+        connectedEndpoints.insert(sender_endpoint);
+        LOG_INFO("Client connected: {}", sender_endpoint);
+      }
     }
 
-    if (length > 0)
+    // The reaper may have run while a handshake reply was being sent and evicted a session
+    // admitted earlier in this batch. Nothing below suspends before the delta and tick
+    // branches use a datagram, so checking once here keeps them from reviving its state.
+    if (sessions)
     {
-      string msg(data, length);
-      auto start = std::chrono::high_resolution_clock::now();
-      for (auto& recipient : connectedEndpoints)
+      for (size_t i = 0; i < count; ++i)
       {
-        try
+        admitted[i] = admitted[i] && sessions->is_open(wire::MessageView(static_cast<const char*>(received.data(i).data())).session(), received.sender(i));
+      }
+    }
+
+    if (count > 0 && reliableMode)
+    {
+      // Register every sender first, so this batch's messages already reach them
+      for (size_t i = 0; i < count; ++i)
+      {
+        connections.try_emplace(received.sender(i));
+      }
+      for (size_t i = 0; i < count; ++i)
+      {
+        receiveReliable(received.sender(i), static_cast<const char*>(received.data(i).data()), received.data(i).size());
+      }
+      co_await flushAll(socket);
+    }
+    else if (count > 0 && snapshotHistory)
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (!admitted[i])
         {
-          co_await socket.async_send_to(boost::asio::buffer(msg), recipient, use_awaitable);
+          continue;
         }
-        catch (const std::exception& e)
+        snapshotHistory->receive(received.sender(i), static_cast<const char*>(received.data(i).data()), received.data(i).size());
+      }
+    }
+    else if (count > 0 && tickMode)
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (admitted[i] && received.data(i).size() > 0)
         {
-          cerr << "Write error: " << e.what() << endl;
+          tickAggregator->add(static_cast<const char*>(received.data(i).data()), received.data(i).size());
+        }
+      }
+    }
+    else if (count > 0)
+    {
+      // The slab is only refilled by this coroutine, so the batch can be sent straight from it
+      auto start = std::chrono::high_resolution_clock::now();
+      size_t messages = 0;
+      // Copy to avoid iterator invalidation: the reaper may evict clients while a send is suspended
+      recipients.assign(connectedEndpoints.begin(), connectedEndpoints.end());
+      for (auto& recipient : recipients)
+      {
+        for (size_t i = 0; i < count; ++i)
+        {
+          if (!admitted[i] || received.data(i).size() == 0)
+          {
+            continue;
+          }
+          messages++;
+          try
+          {
+            metrics::sent(co_await socket.async_send_to(received.data(i), recipient, use_awaitable));
+          }
+          catch (const std::exception& e)
+          {
+            LOG_WARN("Write error: {}", e.what());
+            metrics::send_error();
+          }
         }
       }
       auto end = std::chrono::high_resolution_clock::now();
-      cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << endl;
+      if (messages > 0)
+      {
+        metrics::fanout(end - start);
+      }
+    }
+  }
+}
+
+awaitable<void> sendPackets(udp::socket& socket, const vector<string>& packets, const udp::endpoint& recipient)
+{
+  for (auto& packet : packets)
+  {
+    try
+    {
+      metrics::sent(co_await socket.async_send_to(boost::asio::buffer(packet), recipient, use_awaitable));
+    }
+    catch (const std::exception& e)
+    {
+      LOG_WARN("Write error: {}", e.what());
+      metrics::send_error();
     }
   }
 }
 
+// Clients sharing a baseline share one encoding; clients already up to date get nothing
+awaitable<void> sendSnapshots(udp::socket& socket)
+{
+  auto& groups = snapshotHistory->publish(connectedEndpoints);
+  if (groups.empty())
+  {
+    co_return;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (auto& group : groups)
+  {
+    for (auto& recipient : group.clients)
+    {
+      co_await sendPackets(socket, group.datagrams, recipient);
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  metrics::fanout(end - start);
+}
+
+awaitable<void> ticker(udp::socket& socket, std::chrono::steady_clock::duration period)
+{
+  boost::asio::steady_timer timer(socket.get_executor());
+  auto next = std::chrono::steady_clock::now() + period;
+  vector<string> packets;
+  vector<udp::endpoint> recipients;
+  while (true)
+  {
+    // Fixed schedule, so a slow tick does not shift every later one
+    timer.expires_at(next);
+    co_await timer.async_wait(use_awaitable);
+    next += period;
+
+    if (snapshotHistory)
+    {
+      co_await sendSnapshots(socket);
+      continue;
+    }
+
+    packets.clear();
+    tickAggregator->take(packets);
+    if (packets.empty())
+    {
+      continue;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    // Copy to avoid iterator invalidation, as in the listener
+    recipients.assign(connectedEndpoints.begin(), connectedEndpoints.end());
+    for (auto& recipient : recipients)
+    {
+      co_await sendPackets(socket, packets, recipient);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    metrics::fanout(end - start);
+  }
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  CommandLine args(argc, argv);
+  if (args.size() < 1)
   {
-    cerr << "Usage: " << argv[0] << " <port>" << endl;
+    cerr << "Usage: " << argv[0] << " <port> [--recv-batch=N] [--tick-rate=HZ] [--binary] [--delta [--snapshot-history=N]] [--reliable [--flush-ms=N]] [--sessions [--idle-timeout=S] [--max-sessions=N]] [metrics options]" << endl;
+    cerr << "  --recv-batch=N        drain up to N datagrams per wakeup with recvmmsg (default 1)" << endl;
+    cerr << "  --tick-rate=HZ        aggregate messages and send them once per tick (default 0 = echo immediately)" << endl;
+    cerr << "  --binary              clients send binary wire frames; tick packets concatenate them without separator" << endl;
+    cerr << "  --delta               per tick, send each client a delta-compressed world snapshot (needs --binary and --tick-rate)" << endl;
+    cerr << "  --snapshot-history=N  snapshots kept as delta baselines (default 32, at most 64)" << endl;
+    cerr << "  --reliable            clients speak the reliability layer (UDPSimpleBroadcastLoadTest --reliable)" << endl;
+    cerr << "  --flush-ms=N          resend and acknowledgement interval in reliable mode (default 10)" << endl;
+    cerr << "  --sessions            clients connect with a handshake and send their session id in every frame (needs --binary)" << endl;
+    cerr << "  --idle-timeout=S      evict sessions silent for S seconds (default 0 = never)" << endl;
+    cerr << "  --max-sessions=N      session table capacity (default and maximum 65535)" << endl;
+    metrics::print_usage(cerr);
     return 1;
   }
 
   io_context ctx;
-  string arg = argv[1];
+  string arg = args[0];
   size_t pos;
   unsigned short port = stoi(arg, &pos);
 
   boost::asio::signal_set signals(ctx, SIGINT, SIGTERM);
   signals.async_wait([&](auto, auto) { ctx.stop(); });
-  auto listen = listener(ctx, port);
+  size_t batch_size = static_cast<size_t>(std::max(1LL, args.getInt("recv-batch", 1)));
+  double tick_rate = args.getDouble("tick-rate", 0);
+  if (args.has("delta") && (tick_rate <= 0 || !args.has("binary")))
+  {
+    cerr << "--delta needs --binary and --tick-rate" << endl;
+    return 1;
+  }
+  long long snapshot_history = args.getInt("snapshot-history", 32);
+  if (snapshot_history < 1 || snapshot_history > static_cast<long long>(delta::max_snapshot_history))
+  {
+    cerr << "--snapshot-history must be between 1 and " << delta::max_snapshot_history << endl;
+    return 1;
+  }
+  reliableMode = args.has("reliable");
+  if (reliableMode && tick_rate > 0)
+  {
+    cerr << "--reliable cannot be combined with --tick-rate" << endl;
+    return 1;
+  }
+
+  if (args.has("sessions") && (!args.has("binary") || reliableMode))
+  {
+    cerr << "--sessions needs --binary and cannot be combined with --reliable" << endl;
+    return 1;
+  }
+
+  udp::socket socket(ctx, { udp::v4(), port });
+  cout << "Server listening on port " << port << "..." << endl;
+  metrics::start_reporting(args, "UDPSimpleBroadcastAsyncServer");
+  auto listen = listener(socket, batch_size);
   co_spawn(ctx, move(listen), boost::asio::detached);
+  if (args.has("sessions"))
+  {
+    double idle_timeout = std::max(0.0, args.getDouble("idle-timeout", 0));
+    size_t capacity = static_cast<size_t>(std::max(1LL, args.getInt("max-sessions", SessionTable::max_capacity)));
+    sessions = std::make_unique<SessionTable>(capacity, std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(idle_timeout)));
+    cout << "Sessions: idle timeout " << idle_timeout << "s" << endl;
+    if (idle_timeout > 0)
+    {
+      co_spawn(ctx, reaper(socket), boost::asio::detached);
+    }
+  }
+  if (reliableMode)
+  {
+    long long flush_ms = std::max(1LL, args.getInt("flush-ms", 10));
+    flushInterval = std::chrono::milliseconds(flush_ms);
+    cout << "Reliable mode: flushing every " << flush_ms << "ms" << endl;
+    co_spawn(ctx, flusher(socket), boost::asio::detached);
+  }
+  if (tick_rate > 0)
+  {
+    tickMode = true;
+    tickAggregator = std::make_unique<TickAggregator>(1024, args.has("binary") ? "" : "\n");
+    if (args.has("delta"))
+    {
+      snapshotHistory = std::make_unique<delta::SnapshotHistory<udp::endpoint>>(static_cast<size_t>(snapshot_history));
+      cout << "Delta snapshots" << endl;
+    }
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / tick_rate));
+    cout << "Tick mode: " << tick_rate << " Hz" << endl;
+    co_spawn(ctx, ticker(socket, period), boost::asio::detached);
+  }
   ctx.run();
 }
\ No newline at end of file
@@ -10,15 +10,309 @@
 #include <boost/asio.hpp>
 #include <functional>
 #include <latch>
+#include <fstream>
+#include <random>
+#include "CommandLine.hpp"
+#include "WireProtocol.hpp"
+#include "LatencyHistogram.hpp"
+#include "CoroutineClientPool.hpp"
+#include "CpuAffinity.hpp"
+#include "LatencyTimeSeries.hpp"
+#include "InterestGrid.hpp"
+#include "DeltaSnapshots.hpp"
+#include "ReliableUdp.hpp"
 
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
 using boost::asio::ip::udp;
 
+// Each client records into its own histogram without locking and merges it here once at the end
 std::mutex latencies_mutex;
-std::vector<long long> latencies;
+LatencyHistogram latencies;
 std::atomic<int> errors{0};
+// Every message any client received, own echoes or not, to show the fan-out per message
+std::atomic<uint64_t> messages_received{0};
+// Datagram bytes in both directions, acknowledgements included
+std::atomic<uint64_t> bytes_received{0};
+std::atomic<uint64_t> bytes_sent{0};
+
+// Binary mode: send and match wire frames instead of "timestamp|id" text
+bool binary_mode = false;
+
+// CPUs the client threads are pinned to (round-robin), empty = no pinning
+std::vector<int> client_cpus;
+
+long long now_us()
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+// Open-loop mode: every client sends 'rate' messages per second for 'duration'
+double open_loop_rate = 0;
+std::chrono::seconds open_loop_duration(10);
+// How long clients keep listening after their last scheduled send
+constexpr std::chrono::seconds open_loop_drain(2);
+
+// --loss=P drops every datagram a client sends or receives with probability P, to see
+// how the servers and the reliability layer cope with a lossy network on one machine
+double loss_rate = 0;
+std::atomic<uint64_t> injected_losses{0};
+
+bool lose()
+{
+    if (loss_rate <= 0)
+    {
+        return false;
+    }
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    if (std::uniform_real_distribution<double>(0, 1)(rng) >= loss_rate)
+    {
+        return false;
+    }
+    injected_losses.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// --reliable: messages go through the reliability layer (server --reliable), on the
+// reliable channel or, with --reliable=sequenced, the unreliable-sequenced one
+bool reliable_mode = false;
+reliable::Channel reliable_channel = reliable::Channel::Reliable;
+std::chrono::milliseconds reliable_flush_interval(10);
+// Every client's reliability counters, summed when it finishes
+std::mutex reliable_totals_mutex;
+reliable::Stats reliable_totals;
+
+// --sessions: every client connects with a handshake first and stamps the session id the
+// server assigned into each frame it sends. If the server answers that the session is
+// gone (evicted after --idle-timeout), the client connects again.
+bool session_mode = false;
+std::atomic<uint64_t> session_reconnects{0};
+
+struct ClientSession
+{
+    uint16_t id = 0;
+};
+
+// --payload=N pads every message with N filler bytes
+std::string payload_padding;
+
+// --world=W: clients move around a W x W square and every message carries the sender's position
+float world_size = 0;
+float move_speed = 10;
+std::chrono::steady_clock::time_point run_start;
+
+Position current_position(int id)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    return simulated_position(id, seconds, world_size, move_speed);
+}
+
+// Prepare message: timestamp|id (timestamp|@x,y|padding|id with --world and --payload), or one wire frame carrying them
+std::string make_message(int id, long long timestamp = now_us(), uint32_t sequence = 0)
+{
+    if (binary_mode && world_size > 0)
+    {
+        std::string payload(wire::position_size, '\0');
+        Position position = current_position(id);
+        wire::store_position(payload.data(), position.x, position.y);
+        payload += payload_padding;
+        return wire::encode(wire::MessageType::PositionedBroadcast, static_cast<uint32_t>(id), sequence, timestamp, payload.data(), payload.size());
+    }
+    if (binary_mode)
+    {
+        return wire::encode(wire::MessageType::Broadcast, static_cast<uint32_t>(id), sequence, timestamp, payload_padding.data(), payload_padding.size());
+    }
+    std::string position = world_size > 0 ? format_position(current_position(id)) + "|" : "";
+    std::string padding = payload_padding.empty() ? "" : payload_padding + "|";
+    return std::to_string(timestamp) + "|" + position + padding + std::to_string(id);
+}
+
+// Calls on_message(sent_ts) for every message in the datagram, with the send
+// timestamp for this client's own echoes and -1 for everyone else's.
+// Every entity record of a delta snapshot counts as one message.
+template <typename OnMessage>
+void scan_datagram(const char* data, size_t length, int id, delta::SnapshotReceiver& snapshots, OnMessage&& on_message)
+{
+    if (binary_mode)
+    {
+        // One or more whole frames per datagram, matched in place
+        wire::for_each_frame(data, length, [&](wire::MessageView frame)
+        {
+            if (frame.type() == wire::MessageType::Snapshot)
+            {
+                snapshots.receive(frame, [&](long long sent_ts)
+                {
+                    messages_received.fetch_add(1, std::memory_order_relaxed);
+                    on_message(sent_ts);
+                });
+                return;
+            }
+            if (frame.type() == wire::MessageType::Accept)
+            {
+                return; // a --sessions server turning away a client without session
+            }
+            messages_received.fetch_add(1, std::memory_order_relaxed);
+            on_message(frame.sender() == static_cast<uint32_t>(id) ? frame.timestamp() : -1);
+        });
+        return;
+    }
+
+    // Tick-mode servers pack several '\n'-separated messages into one datagram
+    std::string datagram(data, length);
+    std::string suffix = "|" + std::to_string(id);
+    size_t begin = 0;
+    while (begin < datagram.size())
+    {
+        size_t newline = datagram.find('\n', begin);
+        if (newline == std::string::npos)
+        {
+            newline = datagram.size();
+        }
+        std::string line = datagram.substr(begin, newline - begin);
+        begin = newline + 1;
+        messages_received.fetch_add(1, std::memory_order_relaxed);
+
+        long long sent_ts = -1;
+        if (line.size() > suffix.size() && line.compare(line.size() - suffix.size(), suffix.size(), suffix) == 0) 
+        {
+            try 
+            {
+                sent_ts = std::stoll(line.substr(0, line.size() - suffix.size()));
+            } 
+            catch (...) 
+            {
+            }
+        }
+        on_message(sent_ts);
+    }
+}
+
+// Records the RTT of every message in the datagram that is this client's own echo.
+// Returns true if there was one.
+bool record_datagram(const char* data, size_t length, int id, delta::SnapshotReceiver& snapshots, LatencyHistogram& histogram)
+{
+    bool found = false;
+    bytes_received.fetch_add(length, std::memory_order_relaxed);
+    scan_datagram(data, length, id, snapshots, [&](long long sent_ts)
+    {
+        if (sent_ts >= 0)
+        {
+            // save latency data for this client
+            histogram.record(now_us() - sent_ts);
+            found = true;
+        }
+    });
+    return found;
+}
+
+// The acknowledgement of the snapshot the last datagram completed, empty if there is none to send
+std::string take_ack(delta::SnapshotReceiver& snapshots, int id)
+{
+    uint32_t snapshot = snapshots.take_ack();
+    if (snapshot == 0)
+    {
+        return {};
+    }
+    bytes_sent.fetch_add(wire::header_size, std::memory_order_relaxed);
+    return wire::encode(wire::MessageType::SnapshotAck, static_cast<uint32_t>(id), snapshot, now_us());
+}
+
+void stamp(std::string& frame, const ClientSession& session)
+{
+    if (session_mode && !frame.empty())
+    {
+        wire::set_session(frame.data(), session.id);
+    }
+}
+
+std::string make_connect(int id)
+{
+    bytes_sent.fetch_add(wire::header_size, std::memory_order_relaxed);
+    return wire::encode(wire::MessageType::Connect, static_cast<uint32_t>(id), 0, now_us());
+}
+
+// True if the datagram is the server's Accept, which then updates the session. An Accept
+// without session means the server no longer knows this client, and 'reply' is set to
+// the Connect that asks for a new session.
+bool handle_accept(const char* data, size_t length, int id, ClientSession& session, std::string& reply)
+{
+    reply.clear();
+    if (!session_mode || length != wire::header_size || wire::MessageView(data).type() != wire::MessageType::Accept)
+    {
+        return false;
+    }
+    uint16_t assigned = wire::MessageView(data).session();
+    if (assigned == 0 && session.id != 0)
+    {
+        session_reconnects.fetch_add(1, std::memory_order_relaxed);
+        reply = make_connect(id);
+    }
+    session.id = assigned;
+    return true;
+}
+
+// Connect handshake, retried a few times in case a datagram was lost. Returns the
+// session id, or 0 if the server never accepted.
+awaitable<uint16_t> open_session(udp::socket& socket, int id)
+{
+    boost::asio::steady_timer timer(socket.get_executor());
+    char buffer[1024];
+    ClientSession session;
+    std::string ignored;
+    for (int attempt = 0; attempt < 5; ++attempt)
+    {
+        std::string connect = make_connect(id);
+        if (!lose())
+        {
+            co_await socket.async_send(boost::asio::buffer(connect), use_awaitable);
+        }
+
+        // The timer cancels the receive if no Accept arrives in time
+        timer.expires_after(std::chrono::milliseconds(500));
+        timer.async_wait([&](const boost::system::error_code& ec)
+        {
+            if (!ec)
+            {
+                socket.cancel();
+            }
+        });
+        try
+        {
+            while (true)
+            {
+                size_t length = co_await socket.async_receive(boost::asio::buffer(buffer), use_awaitable);
+                if (lose())
+                {
+                    continue;
+                }
+                bytes_received.fetch_add(length, std::memory_order_relaxed);
+                if (handle_accept(buffer, length, id, session, ignored) && session.id != 0)
+                {
+                    timer.cancel();
+                    co_return session.id;
+                }
+            }
+        }
+        catch (const boost::system::system_error& e)
+        {
+            if (e.code() != boost::asio::error::operation_aborted)
+            {
+                throw;
+            }
+        }
+    }
+    co_return 0;
+}
 
 void run_client(int id, const std::string& host, const std::string& port, std::latch& start_latch)
 {
+    if (!client_cpus.empty())
+    {
+        pin_this_thread(client_cpus[static_cast<size_t>(id) % client_cpus.size()]);
+    }
+
+    LatencyHistogram histogram;
     bool connected = false;
     try
     {
@@ -31,14 +325,15 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
         start_latch.arrive_and_wait();
         connected = true;
 
-        // Prepare message: timestamp|id
-        auto now = std::chrono::high_resolution_clock::now();
-        long long timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-        std::string msg = std::to_string(timestamp) + "|" + std::to_string(id);
-
-        socket.send(boost::asio::buffer(msg));
+        std::string msg = make_message(id);
+        if (!lose())
+        {
+            socket.send(boost::asio::buffer(msg));
+            bytes_sent += msg.size();
+        }
 
         char buffer[1024];
+        delta::SnapshotReceiver snapshots(static_cast<uint32_t>(id));
         boost::asio::steady_timer timer(io_context);
         timer.expires_after(std::chrono::seconds(10));
         
@@ -65,29 +360,15 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
                 return;
             }
 
-            std::string line(buffer, length);
-
-            std::string suffix = "|" + std::to_string(id);
-            if (line.find(suffix) != std::string::npos) 
+            if (!lose() && record_datagram(buffer, length, id, snapshots, histogram))
             {
-                auto end = std::chrono::high_resolution_clock::now();
-                long long current = std::chrono::duration_cast<std::chrono::microseconds>(end.time_since_epoch()).count();
-                size_t delim = line.find('|');
-                if (delim != std::string::npos) 
-                {
-                    try 
-                    {
-                        long long sent_ts = std::stoll(line.substr(0, delim));
-                        long long rtt = current - sent_ts;
-                        std::lock_guard<std::mutex> lock(latencies_mutex);
-                        // save latency data for this client
-                        latencies.push_back(rtt);
-                        foundMyMessage = true;
-                    } 
-                    catch (...) 
-                    {
-                    }
-                }
+                foundMyMessage = true;
+            }
+            std::string ack = take_ack(snapshots, id);
+            if (!ack.empty() && !lose())
+            {
+                boost::system::error_code ignored_ec;
+                socket.send(boost::asio::buffer(ack), 0, ignored_ec);
             }
             
             socket.async_receive(boost::asio::buffer(buffer), read_handler);
@@ -104,37 +385,525 @@ void run_client(int id, const std::string& host, const std::string& port, std::l
         }
         errors++;
     }
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    latencies.merge(histogram);
+}
+
+// Same client as run_client, as a coroutine sharing its worker thread with many others
+awaitable<void> run_coroutine_client(int id, udp::endpoint server, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    udp::socket socket(worker.ctx);
+    try
+    {
+        socket.connect(server);
+    }
+    catch (const std::exception& e)
+    {
+        pool.arrive();
+        errors++;
+        co_return;
+    }
+
+    ClientSession session;
+    if (session_mode)
+    {
+        try
+        {
+            session.id = co_await open_session(socket, id);
+        }
+        catch (const std::exception& e)
+        {
+        }
+        if (session.id == 0)
+        {
+            pool.arrive();
+            errors++;
+            co_return;
+        }
+    }
+
+    // wait until all clients are connected before sending messages
+    co_await pool.arrive_and_wait(worker);
+
+    bool foundMyMessage = false;
+    try
+    {
+        std::string msg = make_message(id);
+        stamp(msg, session);
+        if (!lose())
+        {
+            co_await socket.async_send(boost::asio::buffer(msg), use_awaitable);
+            bytes_sent += msg.size();
+        }
+
+        // keep connecting for up to 10 seconds to receive as many broadcasted messages as possible
+        boost::asio::steady_timer timer(worker.ctx);
+        timer.expires_after(std::chrono::seconds(10));
+        timer.async_wait([&](const boost::system::error_code& ec) 
+        {
+            if (!ec) 
+            {
+                socket.close();
+            }
+        });
+
+        char buffer[1024];
+        delta::SnapshotReceiver snapshots(static_cast<uint32_t>(id));
+        std::string reply;
+        while (true)
+        {
+            size_t length = co_await socket.async_receive(boost::asio::buffer(buffer), use_awaitable);
+            if (lose())
+            {
+                continue;
+            }
+            if (handle_accept(buffer, length, id, session, reply))
+            {
+                bytes_received.fetch_add(length, std::memory_order_relaxed);
+                if (!reply.empty() && !lose())
+                {
+                    co_await socket.async_send(boost::asio::buffer(reply), use_awaitable);
+                }
+                continue;
+            }
+            if (record_datagram(buffer, length, id, snapshots, worker.histogram))
+            {
+                foundMyMessage = true;
+            }
+            std::string ack = take_ack(snapshots, id);
+            stamp(ack, session);
+            if (!ack.empty() && !lose())
+            {
+                co_await socket.async_send(boost::asio::buffer(ack), use_awaitable);
+            }
+        }
+    }
+    catch (const boost::system::system_error& e)
+    {
+        if (!foundMyMessage && e.code() != boost::asio::error::operation_aborted) 
+        {
+            errors++;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        errors++;
+    }
+}
+
+size_t second_of(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point t)
+{
+    return t < start ? 0 : static_cast<size_t>(std::chrono::duration_cast<std::chrono::seconds>(t - start).count());
+}
+
+void record_open_loop(long long sent_ts, std::chrono::steady_clock::time_point now, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    worker.series.record_received(second_of(pool.start_time(), now));
+    if (sent_ts >= 0)
+    {
+        long long rtt = now_us() - sent_ts;
+        worker.histogram.record(rtt);
+        worker.series.record_latency(second_of(pool.start_time(), now - std::chrono::microseconds(rtt)), rtt);
+    }
+}
+
+awaitable<void> read_open_loop(std::shared_ptr<udp::socket> socket, std::shared_ptr<ClientSession> session, int id, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    try
+    {
+        char buffer[1024];
+        delta::SnapshotReceiver snapshots(static_cast<uint32_t>(id));
+        std::string reply;
+        while (true)
+        {
+            size_t length = co_await socket->async_receive(boost::asio::buffer(buffer), use_awaitable);
+            if (lose())
+            {
+                continue;
+            }
+            bytes_received.fetch_add(length, std::memory_order_relaxed);
+            if (handle_accept(buffer, length, id, *session, reply))
+            {
+                if (!reply.empty() && !lose())
+                {
+                    co_await socket->async_send(boost::asio::buffer(reply), use_awaitable);
+                }
+                continue;
+            }
+
+            // Every message counts as received; own echoes are filed under the second they were scheduled in
+            auto now = std::chrono::steady_clock::now();
+            scan_datagram(buffer, length, id, snapshots, [&](long long sent_ts)
+            {
+                record_open_loop(sent_ts, now, pool, worker);
+            });
+            std::string ack = take_ack(snapshots, id);
+            stamp(ack, *session);
+            if (!ack.empty() && !lose())
+            {
+                co_await socket->async_send(boost::asio::buffer(ack), use_awaitable);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // closed by the sender after the drain period
+    }
+}
+
+// Open-loop client: sends on a fixed schedule no matter how fast echoes come back.
+// Each message carries its *scheduled* send time, so when the client falls behind
+// the delay counts as latency instead of silently thinning out the load -- the
+// coordinated omission correction. Lost datagrams show up as missing echoes.
+awaitable<void> run_open_loop_client(int id, int clients, udp::endpoint server, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    auto socket = std::make_shared<udp::socket>(worker.ctx);
+    try
+    {
+        socket->connect(server);
+    }
+    catch (const std::exception& e)
+    {
+        pool.arrive();
+        errors++;
+        co_return;
+    }
+
+    auto session = std::make_shared<ClientSession>();
+    if (session_mode)
+    {
+        try
+        {
+            session->id = co_await open_session(*socket, id);
+        }
+        catch (const std::exception& e)
+        {
+        }
+        if (session->id == 0)
+        {
+            pool.arrive();
+            errors++;
+            co_return;
+        }
+    }
+
+    co_await pool.arrive_and_wait(worker);
+    boost::asio::co_spawn(worker.ctx, read_open_loop(socket, session, id, pool, worker), boost::asio::detached);
+
+    // Clients are phase-shifted evenly across one period instead of all sending at once
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / open_loop_rate));
+    auto start = pool.start_time();
+    auto end = start + open_loop_duration;
+    auto next = start + period * id / clients;
+
+    boost::asio::steady_timer timer(worker.ctx);
+    try
+    {
+        for (uint32_t sequence = 0; next < end; ++sequence, next += period)
+        {
+            timer.expires_at(next);
+            co_await timer.async_wait(use_awaitable);
+
+            long long lag = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - next).count();
+            std::string msg = make_message(id, now_us() - lag, sequence);
+            stamp(msg, *session);
+            if (!lose())
+            {
+                co_await socket->async_send(boost::asio::buffer(msg), use_awaitable);
+                bytes_sent += msg.size();
+            }
+            worker.series.record_sent(second_of(start, next));
+        }
+
+        timer.expires_after(open_loop_drain);
+        co_await timer.async_wait(use_awaitable);
+    }
+    catch (const std::exception& e)
+    {
+        errors++;
+    }
+
+    boost::system::error_code ignored_ec;
+    socket->close(ignored_ec);
+}
+
+// A client of the reliability layer: every datagram it sends or receives is a packet
+// of its connection, and the messages inside are the same ones the other modes send bare
+struct ReliableClient
+{
+    ReliableClient(boost::asio::io_context& ctx, int id)
+        : socket(ctx), connection(static_cast<uint32_t>(id))
+    {
+    }
+
+    udp::socket socket;
+    reliable::Connection connection;
+    size_t own_echoes = 0;
+};
+
+// Sends every packet the connection has ready, minus the injected losses
+awaitable<void> flush_reliable(ReliableClient& client)
+{
+    std::string packet;
+    while (client.connection.write_packet(packet, now_us()))
+    {
+        if (lose())
+        {
+            continue;
+        }
+        co_await client.socket.async_send(boost::asio::buffer(packet), use_awaitable);
+        bytes_sent += packet.size();
+    }
+}
+
+// Resends and acknowledgements that had nothing to ride along with, until the socket closes
+awaitable<void> reliable_flusher(std::shared_ptr<ReliableClient> client)
+{
+    boost::asio::steady_timer timer(client->socket.get_executor());
+    try
+    {
+        while (client->socket.is_open())
+        {
+            timer.expires_after(reliable_flush_interval);
+            co_await timer.async_wait(use_awaitable);
+            co_await flush_reliable(*client);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // closed by the sender
+    }
+}
+
+awaitable<void> read_reliable(std::shared_ptr<ReliableClient> client, int id, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    delta::SnapshotReceiver snapshots(static_cast<uint32_t>(id));
+    auto on_message = [&](long long sent_ts)
+    {
+        if (open_loop_rate > 0)
+        {
+            record_open_loop(sent_ts, std::chrono::steady_clock::now(), pool, worker);
+        }
+        else if (sent_ts >= 0)
+        {
+            worker.histogram.record(now_us() - sent_ts);
+        }
+        client->own_echoes += sent_ts >= 0 ? 1 : 0;
+    };
+
+    try
+    {
+        char buffer[1024];
+        while (true)
+        {
+            size_t length = co_await client->socket.async_receive(boost::asio::buffer(buffer), use_awaitable);
+            if (lose())
+            {
+                continue;
+            }
+            bytes_received.fetch_add(length, std::memory_order_relaxed);
+            wire::for_each_frame(buffer, length, [&](wire::MessageView packet)
+            {
+                client->connection.receive(packet, now_us(), [&](reliable::Channel, const char* data, size_t size)
+                {
+                    scan_datagram(data, size, id, snapshots, on_message);
+                });
+            });
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // closed by the sender
+    }
+}
+
+// Closed loop (one message, then listen for 10 seconds) or open loop like the bare
+// clients, with the messages going through the client's reliability layer connection
+awaitable<void> run_reliable_client(int id, int clients, udp::endpoint server, CoroutineClientPool& pool, CoroutineClientPool::Worker& worker)
+{
+    auto client = std::make_shared<ReliableClient>(worker.ctx, id);
+    try
+    {
+        client->socket.connect(server);
+    }
+    catch (const std::exception& e)
+    {
+        pool.arrive();
+        errors++;
+        co_return;
+    }
+
+    co_await pool.arrive_and_wait(worker);
+    boost::asio::co_spawn(worker.ctx, read_reliable(client, id, pool, worker), boost::asio::detached);
+    boost::asio::co_spawn(worker.ctx, reliable_flusher(client), boost::asio::detached);
+
+    boost::asio::steady_timer timer(worker.ctx);
+    try
+    {
+        if (open_loop_rate > 0)
+        {
+            // Same phase-shifted schedule and coordinated omission correction as run_open_loop_client
+            auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / open_loop_rate));
+            auto start = pool.start_time();
+            auto end = start + open_loop_duration;
+            auto next = start + period * id / clients;
+            for (uint32_t sequence = 0; next < end; ++sequence, next += period)
+            {
+                timer.expires_at(next);
+                co_await timer.async_wait(use_awaitable);
+
+                long long lag = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - next).count();
+                std::string msg = make_message(id, now_us() - lag, sequence);
+                client->connection.send(reliable_channel, msg.data(), msg.size());
+                co_await flush_reliable(*client);
+                worker.series.record_sent(second_of(start, next));
+            }
+            timer.expires_after(open_loop_drain);
+        }
+        else
+        {
+            std::string msg = make_message(id);
+            client->connection.send(reliable_channel, msg.data(), msg.size());
+            co_await flush_reliable(*client);
+            timer.expires_after(std::chrono::seconds(10));
+        }
+        co_await timer.async_wait(use_awaitable);
+    }
+    catch (const std::exception& e)
+    {
+        errors++;
+    }
+
+    if (open_loop_rate <= 0 && client->own_echoes == 0)
+    {
+        errors++;
+    }
+    boost::system::error_code ignored_ec;
+    client->socket.close(ignored_ec);
+
+    const reliable::Stats& stats = client->connection.statistics();
+    std::lock_guard<std::mutex> lock(reliable_totals_mutex);
+    reliable_totals.packets_sent += stats.packets_sent;
+    reliable_totals.packets_received += stats.packets_received;
+    reliable_totals.messages_delivered += stats.messages_delivered;
+    reliable_totals.messages_resent += stats.messages_resent;
+    reliable_totals.messages_abandoned += stats.messages_abandoned;
+    reliable_totals.messages_skipped += stats.messages_skipped;
+    reliable_totals.out_of_order += stats.out_of_order;
+    reliable_totals.stale += stats.stale;
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc < 4)
+    CommandLine args(argc, argv);
+    if (args.size() < 3)
     {
-        std::cerr << "Usage: " << argv[0] << " <host> <port> <clients>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <host> <port> <clients> [--binary] [--histogram[=FILE]] [--coroutines] [--io-threads=N] [--cpus=LIST] [--rate=R] [--duration=S] [--payload=N] [--world=W [--speed=S]] [--reliable[=sequenced] [--flush-ms=N]] [--sessions] [--loss=P]" << std::endl;
+        std::cerr << "  --binary            binary wire frames (start the server with --binary too when it runs in tick or interest mode)" << std::endl;
+        std::cerr << "  --histogram[=FILE]  also print the full latency distribution (to FILE if given)" << std::endl;
+        std::cerr << "  --coroutines        run clients as coroutines on a few io threads instead of one thread each" << std::endl;
+        std::cerr << "  --io-threads=N      io threads in coroutine mode (default 1, 0 = hardware concurrency)" << std::endl;
+        std::cerr << "  --cpus=LIST         pin load test threads to these CPUs, e.g. 0-3,8 (default: no pinning)" << std::endl;
+        std::cerr << "  --rate=R            open loop: every client sends R messages/s on a fixed schedule (implies --coroutines)" << std::endl;
+        std::cerr << "  --duration=S        open-loop sending time in seconds (default 10)" << std::endl;
+        std::cerr << "  --payload=N         pad every message with N bytes (default 0, at most 960 for UDP)" << std::endl;
+        std::cerr << "  --world=W           clients move around a W x W world and send their position (server --interest-radius)" << std::endl;
+        std::cerr << "  --speed=S           movement speed in world units per second (default 10)" << std::endl;
+        std::cerr << "  --reliable          send through the reliability layer (server --reliable), =sequenced for the unreliable-sequenced channel (implies --coroutines)" << std::endl;
+        std::cerr << "  --flush-ms=N        reliability layer resend and acknowledgement interval (default 10)" << std::endl;
+        std::cerr << "  --sessions          connect with a handshake and send the session id in every frame (server --sessions, needs --binary, implies --coroutines)" << std::endl;
+        std::cerr << "  --loss=P            drop every datagram sent or received with probability P, e.g. 0.05" << std::endl;
         return 1;
     }
 
-    std::string host = argv[1];
-    std::string port = argv[2];
-    int num_clients = std::stoi(argv[3]);
+    std::string host = args[0];
+    std::string port = args[1];
+    int num_clients = std::stoi(args[2]);
+    binary_mode = args.has("binary");
+    client_cpus = parse_cpu_list(args.get("cpus"));
+    open_loop_rate = args.getDouble("rate", 0);
+    open_loop_duration = std::chrono::seconds(std::max(1LL, args.getInt("duration", 10)));
+    payload_padding.assign(static_cast<size_t>(std::max(0LL, args.getInt("payload", 0))), 'x');
+    world_size = static_cast<float>(std::max(0.0, args.getDouble("world", 0)));
+    move_speed = static_cast<float>(args.getDouble("speed", 10));
+    run_start = std::chrono::steady_clock::now();
+    loss_rate = std::clamp(args.getDouble("loss", 0), 0.0, 1.0);
+    reliable_mode = args.has("reliable");
+    reliable_channel = args.get("reliable") == "sequenced" ? reliable::Channel::Sequenced : reliable::Channel::Reliable;
+    reliable_flush_interval = std::chrono::milliseconds(std::max(1LL, args.getInt("flush-ms", 10)));
+    session_mode = args.has("sessions");
+    if (session_mode && (!binary_mode || reliable_mode))
+    {
+        std::cerr << "--sessions needs --binary and cannot be combined with --reliable" << std::endl;
+        return 1;
+    }
+    if (payload_padding.size() > 960)
+    {
+        // Echoes must still fit the 1024-byte receive buffers of the clients and servers
+        std::cerr << "--payload must be at most 960 bytes for UDP" << std::endl;
+        return 1;
+    }
+    LatencyTimeSeries series;
 
     std::cout << "Spawning " << num_clients << " clients connecting to " << host << ":" << port << "..." << std::endl;
-    std::vector<std::thread> threads;
-    threads.reserve(num_clients);
-
     auto start = std::chrono::high_resolution_clock::now();
-    std::latch start_latch(num_clients);
 
-    for (int i = 0; i < num_clients; ++i)
+    if (args.has("coroutines") || open_loop_rate > 0 || reliable_mode || session_mode)
     {
-        threads.emplace_back(run_client, i, host, port, std::ref(start_latch));
-    }
+        size_t io_threads = static_cast<size_t>(args.getInt("io-threads", 1));
+        if (io_threads == 0) io_threads = std::max(1u, std::thread::hardware_concurrency());
 
-    for (auto& t : threads)
+        boost::asio::io_context resolve_ctx;
+        udp::endpoint server = *udp::resolver(resolve_ctx).resolve(udp::v4(), host, port).begin();
+
+        CoroutineClientPool pool(io_threads, num_clients, client_cpus);
+        std::cout << "Coroutine mode: " << pool.size() << " io thread(s)" << std::endl;
+        for (int i = 0; i < num_clients; ++i)
+        {
+            auto& worker = pool.worker_for(i);
+            if (open_loop_rate > 0)
+            {
+                worker.series.resize(static_cast<size_t>((open_loop_duration + open_loop_drain).count()));
+            }
+            if (reliable_mode)
+            {
+                boost::asio::co_spawn(worker.ctx, run_reliable_client(i, num_clients, server, pool, worker), boost::asio::detached);
+            }
+            else if (open_loop_rate > 0)
+            {
+                boost::asio::co_spawn(worker.ctx, run_open_loop_client(i, num_clients, server, pool, worker), boost::asio::detached);
+            }
+            else
+            {
+                boost::asio::co_spawn(worker.ctx, run_coroutine_client(i, server, pool, worker), boost::asio::detached);
+            }
+        }
+        if (open_loop_rate > 0)
+        {
+            std::cout << "Open loop: " << open_loop_rate << " msg/s per client for " << open_loop_duration.count() << "s" << std::endl;
+        }
+        pool.run();
+        pool.merge_into(latencies);
+        pool.merge_into(series);
+    }
+    else
     {
-        if (t.joinable()) 
+        std::vector<std::thread> threads;
+        threads.reserve(num_clients);
+        std::latch start_latch(num_clients);
+
+        for (int i = 0; i < num_clients; ++i)
+        {
+            threads.emplace_back(run_client, i, host, port, std::ref(start_latch));
+        }
+
+        for (auto& t : threads)
         {
-            t.join();
+            if (t.joinable()) 
+            {
+                t.join();
+            }
         }
     }
 
@@ -143,14 +912,51 @@ int main(int argc, char* argv[])
 
     std::cout << "Finished " << num_clients << " clients in " << duration << "ms" << std::endl;
     std::cout << "Errors: " << errors << std::endl;
+    std::cout << "Messages received: " << messages_received << " (avg " << (num_clients > 0 ? messages_received / num_clients : 0) << " per client)" << std::endl;
+    std::cout << "Bytes on wire per client: received " << (num_clients > 0 ? bytes_received / num_clients : 0)
+              << ", sent " << (num_clients > 0 ? bytes_sent / num_clients : 0) << std::endl;
+    if (loss_rate > 0)
+    {
+        std::cout << "Injected loss: " << injected_losses << " datagrams dropped" << std::endl;
+    }
+    if (session_mode)
+    {
+        std::cout << "Sessions: " << session_reconnects << " reconnects after the server dropped the session" << std::endl;
+    }
+    if (reliable_mode)
+    {
+        std::cout << "Reliable: packets sent " << reliable_totals.packets_sent << ", received " << reliable_totals.packets_received
+                  << ", messages delivered " << reliable_totals.messages_delivered << ", resent " << reliable_totals.messages_resent
+                  << ", abandoned " << reliable_totals.messages_abandoned << ", skipped " << reliable_totals.messages_skipped << ", out of order " << reliable_totals.out_of_order
+                  << ", stale " << reliable_totals.stale << std::endl;
+    }
+
+    if (latencies.count() > 0)
+    {
+        latencies.print_summary(std::cout);
+    }
 
-    if (!latencies.empty())
+    if (open_loop_rate > 0)
     {
-        long long min_val = *std::min_element(latencies.begin(), latencies.end());
-        long long max_val = *std::max_element(latencies.begin(), latencies.end());
-        long long sum = std::accumulate(latencies.begin(), latencies.end(), 0LL);
-        double avg = static_cast<double>(sum) / latencies.size();
-        std::cout << "Latency (us) -> Min: " << min_val << ", Max: " << max_val << ", Avg: " << avg << std::endl;
+        uint64_t sent = series.total_sent();
+        uint64_t echoes = series.total_echoes();
+        std::cout << "Open loop: sent " << sent << ", own echoes " << echoes << ", lost " << (sent - std::min(sent, echoes)) << std::endl;
+        series.print(std::cout);
+    }
+
+    // --histogram prints the full distribution, --histogram=FILE writes it to a file
+    if (args.has("histogram"))
+    {
+        std::string path = args.get("histogram");
+        if (path.empty())
+        {
+            latencies.print_distribution(std::cout);
+        }
+        else
+        {
+            std::ofstream file(path);
+            latencies.print_distribution(file);
+        }
     }
 
     return 0;
@@ -11,6 +11,17 @@
 #include <boost/asio.hpp>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
+#include "CommandLine.hpp"
+#include "UDPBatch.hpp"
+#include "SnapshotRegistry.hpp"
+#include "SpscRing.hpp"
+#include "TickAggregator.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
+#include "InterestGrid.hpp"
+#include "DeltaSnapshots.hpp"
+#include "SessionTable.hpp"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -18,15 +29,56 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 using boost::asio::ip::udp;
 
-std::set<udp::endpoint> clients;
-std::mutex clients_mutex;
+// Readers never lock: each thread fans out over the current immutable snapshot
+SnapshotRegistry<udp::endpoint> clients;
+
+// 0 keeps the original one send_to per endpoint, otherwise the mmsghdr batch size
+size_t send_batch_size = 0;
+// datagrams drained per wakeup with recvmmsg
+size_t receive_batch_size = 1;
+
+// Tick mode: each server thread collects into its own aggregator and a ticker
+// thread sends the combined packets to every client once per tick
+bool tick_mode = false;
+std::vector<std::unique_ptr<TickAggregator>> tick_aggregators;
 
-void run_server(unsigned short port)
+// Delta mode: the server threads fold frames into the entity states and the ticker sends
+// each client the changes since the last snapshot it acknowledged
+std::unique_ptr<delta::SnapshotHistory<udp::endpoint>> snapshot_history;
+
+// Interest mode: positioned datagrams only go to the clients within the radius of their sender
+struct EndpointHash
+{
+    size_t operator()(const udp::endpoint& ep) const
+    {
+        size_t h = std::hash<unsigned short>{}(ep.port());
+        if (ep.address().is_v4())
+        {
+            return h ^ std::hash<uint32_t>{}(ep.address().to_v4().to_uint());
+        }
+        auto bytes = ep.address().to_v6().to_bytes();
+        return h ^ std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+};
+
+bool binary_mode = false;
+std::unique_ptr<InterestGrid<udp::endpoint, EndpointHash>> interest_grid;
+
+// Session mode: clients connect with a handshake and stamp their session id into every
+// frame, so a datagram is checked with an array index instead of the binary search over
+// 'clients'; the reaper evicts sessions that were silent for the idle timeout
+std::unique_ptr<SessionTable> sessions;
+
+void open_socket(udp::socket& socket, unsigned short port)
 {
-    boost::asio::io_context io_context;
-    udp::socket socket(io_context);
     socket.open(udp::v4());
     socket.set_option(udp::socket::reuse_address(true));
 
@@ -39,70 +91,553 @@ void run_server(unsigned short port)
 #endif
 
     socket.bind(udp::endpoint(udp::v4(), port));
+}
+
+// Sends every payload to every endpoint and records the pass in the server metrics
+template <typename Endpoints>
+void fan_out(udp::socket& socket, SendBatch& batch, const std::vector<boost::asio::const_buffer>& payloads, const Endpoints& endpoints)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    size_t failures = 0;
+    if (send_batch_size > 0)
+    {
+        batch.send(socket, payloads.data(), payloads.size(), endpoints);
+        failures = batch.take_failures();
+    }
+    else
+    {
+        for (const auto& ep : endpoints)
+        {
+            for (const auto& payload : payloads)
+            {
+                boost::system::error_code ec;
+                socket.send_to(payload, ep, 0, ec);
+                if (ec)
+                {
+                    failures++;
+                }
+            }
+        }
+    }
+    
+    auto end = std::chrono::high_resolution_clock::now();
+    metrics::fanout(end - start);
+
+    size_t bytes = 0;
+    for (const auto& payload : payloads)
+    {
+        bytes += payload.size();
+    }
+    size_t attempted = payloads.size() * endpoints.size();
+    metrics::sent(bytes * endpoints.size(), attempted - failures);
+    metrics::send_error(failures);
+}
+
+// Handles the session protocol for one datagram. True if it is to be handled as usual.
+bool admit(udp::socket& socket, const udp::endpoint& sender, const char* data, size_t size, std::string& reply)
+{
+    bool opened = false;
+    if (sessions->admit(sender, data, size, reply, opened))
+    {
+        return true;
+    }
+    if (opened && clients.insert(sender))
+    {
+        LOG_INFO("Client connected: {} session {} handled by thread {}", sender, wire::MessageView(reply.data()).session(), std::this_thread::get_id());
+    }
+    boost::system::error_code ec;
+    size_t sent = socket.send_to(boost::asio::buffer(reply), sender, 0, ec);
+    if (ec)
+    {
+        metrics::send_error();
+    }
+    else
+    {
+        metrics::sent(sent);
+    }
+    return false;
+}
+
+// Whether the reaper closed the session of an admitted datagram while it was handled.
+// The reaper closes a session before it removes the client's state, so state a
+// receiving thread added after the removal is caught here and undone by the caller.
+bool evicted_meanwhile(const udp::endpoint& sender, const char* data)
+{
+    return sessions && !sessions->is_open(wire::MessageView(data).session(), sender);
+}
+
+// Advances the session table's timer wheel and drops the evicted clients from the fan-out
+void run_reaper()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(sessions->tick_length());
+        sessions->expire(std::chrono::steady_clock::now(), [](const udp::endpoint& endpoint, uint32_t client)
+        {
+            clients.erase(endpoint);
+            if (interest_grid)
+            {
+                interest_grid->remove(endpoint);
+            }
+            if (snapshot_history)
+            {
+                snapshot_history->forget(endpoint);
+                snapshot_history->remove(client);
+            }
+            LOG_INFO("Client timed out: {}", endpoint);
+        });
+    }
+}
 
-    char data[1024];
+void run_server(udp::socket& socket, size_t index)
+{
+    SnapshotRegistry<udp::endpoint>::Reader clients_view(clients);
+    ReceiveBatch received(receive_batch_size);
+    SendBatch batch(send_batch_size);
+    std::vector<boost::asio::const_buffer> payloads;
+    payloads.reserve(received.size());
+    std::vector<udp::endpoint> recipients;
+    std::vector<boost::asio::const_buffer> positioned(1);
+    std::vector<bool> admitted;
+    std::string reply;
     try 
     {
         while (true) 
         {
-            udp::endpoint sender_endpoint;
-            size_t len = socket.receive_from(boost::asio::buffer(data), sender_endpoint);
+            size_t count = received.receive(socket);
+
+            admitted.assign(count, true);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const udp::endpoint& sender_endpoint = received.sender(i);
+                if (sessions)
+                {
+                    admitted[i] = admit(socket, sender_endpoint, static_cast<const char*>(received.data(i).data()), received.data(i).size(), reply);
+                }
+                else if (!clients_view.contains(sender_endpoint) && clients.insert(sender_endpoint))
+                {
+                    LOG_INFO("Client connected: {} handled by thread {}", sender_endpoint, std::this_thread::get_id());
+                }
+            }
 
+            if (snapshot_history)
             {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                if (clients.find(sender_endpoint) == clients.end())
+                for (size_t i = 0; i < count; ++i)
                 {
-                    clients.insert(sender_endpoint);
-                    std::cout << "Client connected: " << sender_endpoint << " handled by thread " << std::this_thread::get_id() << std::endl;
+                    metrics::received(received.data(i).size());
+                    if (!admitted[i])
+                    {
+                        continue;
+                    }
+                    const char* data = static_cast<const char*>(received.data(i).data());
+                    snapshot_history->receive(received.sender(i), data, received.data(i).size());
+                    if (evicted_meanwhile(received.sender(i), data))
+                    {
+                        snapshot_history->forget(received.sender(i));
+                        snapshot_history->remove(wire::MessageView(data).sender());
+                    }
                 }
+                continue;
             }
 
-            if (len > 0)
+            // Every non-empty datagram of this wakeup goes out in the same fan-out pass,
+            // except positioned ones, which each get their own set of nearby recipients
+            payloads.clear();
+            for (size_t i = 0; i < count; ++i)
             {
-                std::string msg(data, len);
-                auto start = std::chrono::high_resolution_clock::now();
-                
-                std::vector<udp::endpoint> endpoints;
+                if (received.data(i).size() == 0)
                 {
-                    std::lock_guard<std::mutex> lock(clients_mutex);
-                    endpoints.assign(clients.begin(), clients.end());
+                    continue;
+                }
+                metrics::received(received.data(i).size());
+                if (!admitted[i])
+                {
+                    continue;
                 }
 
-                for (const auto& ep : endpoints)
+                Position position;
+                if (interest_grid && read_position(static_cast<const char*>(received.data(i).data()), received.data(i).size(), binary_mode, position))
+                {
+                    recipients.clear();
+                    interest_grid->move_and_collect(received.sender(i), position, recipients);
+                    if (evicted_meanwhile(received.sender(i), static_cast<const char*>(received.data(i).data())))
+                    {
+                        interest_grid->remove(received.sender(i));
+                    }
+                    positioned[0] = received.data(i);
+                    fan_out(socket, batch, positioned, recipients);
+                }
+                else
                 {
-                    boost::system::error_code ignored_ec;
-                    socket.send_to(boost::asio::buffer(msg), ep, 0, ignored_ec);
+                    payloads.push_back(received.data(i));
                 }
-                
-                auto end = std::chrono::high_resolution_clock::now();
-                std::cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+            }
+
+            if (payloads.empty())
+            {
+                continue;
+            }
+
+            if (tick_mode)
+            {
+                for (const auto& payload : payloads)
+                {
+                    tick_aggregators[index]->add(static_cast<const char*>(payload.data()), payload.size());
+                }
+            }
+            else
+            {
+                fan_out(socket, batch, payloads, clients_view.current());
             }
         }
     } 
     catch (std::exception& e) 
     {
-        std::cerr << "Server error: " << e.what() << std::endl;
+        LOG_ERROR("Server error: {}", e.what());
     }
 }
 
+// Synchronous sends only read the socket's state, so the ticker can share the first server socket
+// (it has to send from the server port, the load test's UDP sockets are connected to it)
+void run_ticker(udp::socket& socket, std::chrono::steady_clock::duration period)
+{
+    SnapshotRegistry<udp::endpoint>::Reader clients_view(clients);
+    SendBatch batch(send_batch_size);
+    std::vector<std::string> packets;
+    std::vector<boost::asio::const_buffer> payloads;
+    auto next = std::chrono::steady_clock::now() + period;
+    while (true)
+    {
+        // Fixed schedule, so a slow tick does not shift every later one
+        std::this_thread::sleep_until(next);
+        next += period;
+
+        if (snapshot_history)
+        {
+            // Clients sharing a baseline share one encoding; clients already up to date get nothing
+            for (const auto& group : snapshot_history->publish(clients_view.current()))
+            {
+                payloads.clear();
+                for (const auto& datagram : group.datagrams)
+                {
+                    payloads.push_back(boost::asio::buffer(datagram));
+                }
+                fan_out(socket, batch, payloads, group.clients);
+            }
+            continue;
+        }
+
+        packets.clear();
+        for (auto& aggregator : tick_aggregators)
+        {
+            aggregator->take(packets);
+        }
+        if (packets.empty())
+        {
+            continue;
+        }
+
+        payloads.clear();
+        for (const auto& packet : packets)
+        {
+            payloads.push_back(boost::asio::buffer(packet));
+        }
+        fan_out(socket, batch, payloads, clients_view.current());
+    }
+}
+
+#ifdef __linux__
+// Sharded mode: every thread owns the clients the kernel hashes to its socket and
+// only ever sends to those. A received message is fanned out locally and handed to
+// every other shard through a dedicated SPSC ring, so the total send work is spread
+// across the threads instead of being repeated by each of them.
+using SharedMessage = std::shared_ptr<const std::string>;
+
+struct Shard
+{
+    // inbound[i] is only pushed by shard i and only popped by this shard
+    std::vector<std::unique_ptr<SpscRing<SharedMessage>>> inbound;
+    int wakeup_fd = -1;
+    std::atomic<bool> sleeping{false};
+};
+
+std::vector<std::unique_ptr<Shard>> shards;
+size_t ring_size = 4096;
+
+void wake(Shard& shard)
+{
+    // Only pay for the eventfd write when the target is (about to be) blocked in poll
+    if (shard.sleeping.exchange(false))
+    {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(shard.wakeup_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void run_shard(udp::socket& socket, size_t index)
+{
+    Shard& self = *shards[index];
+    std::vector<udp::endpoint> own_clients; // sorted, touched by this thread only
+    ReceiveBatch received(receive_batch_size);
+    SendBatch batch(send_batch_size);
+    std::vector<boost::asio::const_buffer> payloads;
+    std::vector<SharedMessage> forwarded;
+
+    pollfd fds[2];
+    fds[0].fd = socket.native_handle();
+    fds[0].events = POLLIN;
+    fds[1].fd = self.wakeup_fd;
+    fds[1].events = POLLIN;
+
+    try
+    {
+        while (true)
+        {
+            // Announce the sleep before the final ring check, so a producer either sees
+            // 'sleeping' and signals the eventfd or its message is found right here.
+            self.sleeping.store(true);
+            bool rings_empty = std::all_of(self.inbound.begin(), self.inbound.end(), [](auto& ring) { return !ring || ring->empty(); });
+            if (rings_empty)
+            {
+                ::poll(fds, 2, -1);
+            }
+            self.sleeping.store(false);
+
+            if (fds[1].revents & POLLIN)
+            {
+                uint64_t ignored;
+                ssize_t ignored_len = ::read(self.wakeup_fd, &ignored, sizeof(ignored));
+                (void)ignored_len;
+            }
+
+            // Local datagrams: register senders, forward to the other shards, send to own clients
+            size_t count = received.try_receive(socket);
+            payloads.clear();
+            for (size_t i = 0; i < count; ++i)
+            {
+                const udp::endpoint& sender_endpoint = received.sender(i);
+                auto pos = std::lower_bound(own_clients.begin(), own_clients.end(), sender_endpoint);
+                if (pos == own_clients.end() || *pos != sender_endpoint)
+                {
+                    own_clients.insert(pos, sender_endpoint);
+                    LOG_INFO("Client connected: {} owned by shard {}", sender_endpoint, index);
+                }
+
+                if (received.data(i).size() == 0)
+                {
+                    continue;
+                }
+                metrics::received(received.data(i).size());
+                payloads.push_back(received.data(i));
+
+                auto msg = std::make_shared<const std::string>(static_cast<const char*>(received.data(i).data()), received.data(i).size());
+                for (size_t target = 0; target < shards.size(); ++target)
+                {
+                    if (target == index)
+                    {
+                        continue;
+                    }
+                    if (shards[target]->inbound[index]->try_push(msg))
+                    {
+                        metrics::queued(1);
+                        wake(*shards[target]);
+                    }
+                    else
+                    {
+                        // Counted rather than logged, this is the overload path
+                        metrics::dropped();
+                    }
+                }
+            }
+
+            // Messages other shards received for our clients
+            forwarded.clear();
+            for (auto& ring : self.inbound)
+            {
+                SharedMessage msg;
+                while (ring && ring->try_pop(msg))
+                {
+                    forwarded.push_back(std::move(msg));
+                }
+            }
+            metrics::queued(-static_cast<int64_t>(forwarded.size()));
+            for (const auto& msg : forwarded)
+            {
+                payloads.push_back(boost::asio::buffer(*msg));
+            }
+
+            if (!payloads.empty() && !own_clients.empty())
+            {
+                fan_out(socket, batch, payloads, own_clients);
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        LOG_ERROR("Server error: {}", e.what());
+    }
+}
+#endif
+
 int main(int argc, char* argv[]) 
 {
-    if (argc < 2) 
+    CommandLine args(argc, argv);
+    if (args.size() < 1) 
     {
-        std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <port> [--batch=N] [--recv-batch=N] [--threads=N] [--sharded] [--ring-size=N] [--tick-rate=HZ] [--binary] [--interest-radius=R [--cell-size=C]] [--delta [--snapshot-history=N]] [--sessions [--idle-timeout=S] [--max-sessions=N]] [metrics options]" << std::endl;
+        std::cerr << "  --batch=N       fan out with sendmmsg, N datagrams per syscall (default 0 = one send_to per client)" << std::endl;
+        std::cerr << "  --recv-batch=N  drain up to N datagrams per wakeup with recvmmsg (default 1)" << std::endl;
+        std::cerr << "  --threads=N     server threads / sockets (default 0 = hardware concurrency)" << std::endl;
+        std::cerr << "  --sharded       each thread sends only to the clients hashed to its socket (Linux only)" << std::endl;
+        std::cerr << "  --ring-size=N   per shard pair message ring capacity in sharded mode (default 4096)" << std::endl;
+        std::cerr << "  --tick-rate=HZ  aggregate messages and send them once per tick (default 0 = echo immediately, not with --sharded)" << std::endl;
+        std::cerr << "  --binary        clients send binary wire frames; tick packets concatenate them without separator, positions are read from the frames" << std::endl;
+        std::cerr << "  --interest-radius=R  send positioned datagrams only to clients within R of the sender (not with --sharded or --tick-rate)" << std::endl;
+        std::cerr << "  --cell-size=C        interest grid cell size (default R, at least R/16)" << std::endl;
+        std::cerr << "  --delta              per tick, send each client a delta-compressed world snapshot (needs --binary and --tick-rate)" << std::endl;
+        std::cerr << "  --snapshot-history=N snapshots kept as delta baselines (default 32, at most 64)" << std::endl;
+        std::cerr << "  --sessions           clients connect with a handshake and send their session id in every frame (needs --binary, not with --sharded)" << std::endl;
+        std::cerr << "  --idle-timeout=S     evict sessions silent for S seconds (default 0 = never)" << std::endl;
+        std::cerr << "  --max-sessions=N     session table capacity (default and maximum 65535)" << std::endl;
+        metrics::print_usage(std::cerr);
         return 1;
     }
 
-    unsigned short port = static_cast<unsigned short>(std::stoi(argv[1]));
+    unsigned short port = static_cast<unsigned short>(std::stoi(args[0]));
+    send_batch_size = static_cast<size_t>(std::max(0LL, args.getInt("batch", 0)));
+    receive_batch_size = static_cast<size_t>(std::max(1LL, args.getInt("recv-batch", 1)));
     std::cout << "Server listening on port " << port << "..." << std::endl;
+    metrics::start_reporting(args, "UDPSimpleBroadcastSO_REUSEPORTServer");
+#ifndef UDP_BATCH_SUPPORTED
+    if (send_batch_size > 0 || receive_batch_size > 1)
+    {
+        std::cerr << "sendmmsg/recvmmsg are not available on this platform, falling back to send_to/receive_from" << std::endl;
+    }
+#endif
 
-    unsigned int thread_count = std::thread::hardware_concurrency();
+    unsigned int thread_count = static_cast<unsigned int>(args.getInt("threads", 0));
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
     if (thread_count == 0) thread_count = 4;
 
-    std::vector<std::thread> threads;
+    // Validated on the parsed values, so e.g. --tick-rate=0 counts as no tick mode
+    double tick_rate = args.getDouble("tick-rate", 0);
+    double interest_radius = args.getDouble("interest-radius", 0);
+    if (args.has("sharded") && tick_rate > 0)
+    {
+        std::cerr << "--tick-rate cannot be combined with --sharded" << std::endl;
+        return 1;
+    }
+
+    binary_mode = args.has("binary");
+    if (args.has("delta") && (!binary_mode || tick_rate <= 0 || interest_radius > 0))
+    {
+        std::cerr << "--delta needs --binary and --tick-rate and cannot be combined with --interest-radius" << std::endl;
+        return 1;
+    }
+    long long snapshot_history_size = args.getInt("snapshot-history", 32);
+    if (snapshot_history_size < 1 || snapshot_history_size > static_cast<long long>(delta::max_snapshot_history))
+    {
+        std::cerr << "--snapshot-history must be between 1 and " << delta::max_snapshot_history << std::endl;
+        return 1;
+    }
+    if (interest_radius > 0 && (args.has("sharded") || tick_rate > 0))
+    {
+        std::cerr << "--interest-radius cannot be combined with --sharded or --tick-rate" << std::endl;
+        return 1;
+    }
+    double cell_size = args.getDouble("cell-size", interest_radius);
+    if (interest_radius > 0 && cell_size < min_cell_size(static_cast<float>(interest_radius)))
+    {
+        std::cerr << "--cell-size must be at least " << min_cell_size(static_cast<float>(interest_radius)) << " (R/16)" << std::endl;
+        return 1;
+    }
+    if (interest_radius > 0)
+    {
+        interest_grid = std::make_unique<InterestGrid<udp::endpoint, EndpointHash>>(static_cast<float>(interest_radius), static_cast<float>(cell_size));
+        std::cout << "Interest radius: " << interest_radius << std::endl;
+    }
+
+    if (args.has("sessions") && (!binary_mode || args.has("sharded")))
+    {
+        std::cerr << "--sessions needs --binary and cannot be combined with --sharded" << std::endl;
+        return 1;
+    }
+    double idle_timeout = std::max(0.0, args.getDouble("idle-timeout", 0));
+    if (args.has("sessions"))
+    {
+        size_t capacity = static_cast<size_t>(std::max(1LL, args.getInt("max-sessions", SessionTable::max_capacity)));
+        sessions = std::make_unique<SessionTable>(capacity, std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(idle_timeout)));
+        std::cout << "Sessions: idle timeout " << idle_timeout << "s" << std::endl;
+    }
+
+    // All sockets join the SO_REUSEPORT group before any thread starts receiving
+    boost::asio::io_context io_context;
+    std::vector<std::unique_ptr<udp::socket>> sockets;
     for (unsigned int i = 0; i < thread_count; ++i)
     {
-        threads.emplace_back(run_server, port);
+        sockets.push_back(std::make_unique<udp::socket>(io_context));
+        open_socket(*sockets.back(), port);
+    }
+
+    std::vector<std::thread> threads;
+    if (args.has("sharded"))
+    {
+#ifdef __linux__
+        ring_size = static_cast<size_t>(std::max(2LL, args.getInt("ring-size", 4096)));
+        for (unsigned int i = 0; i < thread_count; ++i)
+        {
+            auto shard = std::make_unique<Shard>();
+            shard->wakeup_fd = ::eventfd(0, EFD_NONBLOCK);
+            shard->inbound.resize(thread_count);
+            for (unsigned int from = 0; from < thread_count; ++from)
+            {
+                if (from != i)
+                {
+                    shard->inbound[from] = std::make_unique<SpscRing<SharedMessage>>(ring_size);
+                }
+            }
+            shards.push_back(std::move(shard));
+        }
+        std::cout << "Sharded mode: " << thread_count << " shards" << std::endl;
+        for (unsigned int i = 0; i < thread_count; ++i)
+        {
+            threads.emplace_back(run_shard, std::ref(*sockets[i]), i);
+        }
+#else
+        std::cerr << "Sharded mode is only available on Linux" << std::endl;
+        return 1;
+#endif
+    }
+    else
+    {
+        if (tick_rate > 0)
+        {
+            tick_mode = true;
+            if (args.has("delta"))
+            {
+                snapshot_history = std::make_unique<delta::SnapshotHistory<udp::endpoint>>(static_cast<size_t>(snapshot_history_size));
+                std::cout << "Delta snapshots" << std::endl;
+            }
+            for (unsigned int i = 0; i < thread_count; ++i)
+            {
+                // Binary wire frames are self-delimiting, text messages are joined with '\n'
+                tick_aggregators.push_back(std::make_unique<TickAggregator>(1024, args.has("binary") ? "" : "\n"));
+            }
+            auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / tick_rate));
+            std::cout << "Tick mode: " << tick_rate << " Hz" << std::endl;
+            threads.emplace_back(run_ticker, std::ref(*sockets[0]), period);
+        }
+
+        if (sessions && idle_timeout > 0)
+        {
+            threads.emplace_back(run_reaper);
+        }
+        for (unsigned int i = 0; i < thread_count; ++i)
+        {
+            threads.emplace_back(run_server, std::ref(*sockets[i]), i);
+        }
     }
 
     for (auto& t : threads)
@@ -10,16 +10,25 @@
 #include <boost/asio.hpp>
 #include <functional>
 #include <latch>
+#include <fstream>
+#include "CommandLine.hpp"
+#include "WireProtocol.hpp"
+#include "LatencyHistogram.hpp"
 
 using boost::asio::ip::udp;
 using boost::asio::ip::make_address;
 
+// Each client records into its own histogram without locking and merges it here once at the end
 std::mutex latencies_mutex;
-std::vector<long long> latencies;
+LatencyHistogram latencies;
 std::atomic<int> errors{0};
 
+// Binary mode: send and match wire frames instead of "timestamp|id" text
+bool binary_mode = false;
+
 void run_client(int id, const std::string& host, const std::string& port_str, const std::string& multicast_group, std::latch& start_latch)
 {
+    LatencyHistogram histogram;
     bool connected = false;
     try
     {
@@ -48,10 +57,12 @@ void run_client(int id, const std::string& host, const std::string& port_str, co
         start_latch.arrive_and_wait();
         connected = true;
 
-        // Prepare message: timestamp|id
+        // Prepare message: timestamp|id, or one wire frame carrying both
         auto now = std::chrono::high_resolution_clock::now();
         long long timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
-        std::string msg = std::to_string(timestamp) + "|" + std::to_string(id);
+        std::string msg = binary_mode
+            ? wire::encode(wire::MessageType::Broadcast, static_cast<uint32_t>(id), 0, timestamp)
+            : std::to_string(timestamp) + "|" + std::to_string(id);
 
         // Send unicast message to server
         sender_socket.send_to(boost::asio::buffer(msg), *endpoints.begin());
@@ -85,6 +96,23 @@ void run_client(int id, const std::string& host, const std::string& port_str, co
                 return;
             }
 
+            if (binary_mode)
+            {
+                // Matched in place, no copy or parsing
+                wire::for_each_frame(buffer, length, [&](wire::MessageView frame)
+                {
+                    if (frame.sender() == static_cast<uint32_t>(id))
+                    {
+                        auto end = std::chrono::high_resolution_clock::now();
+                        long long current = std::chrono::duration_cast<std::chrono::microseconds>(end.time_since_epoch()).count();
+                        histogram.record(current - frame.timestamp());
+                        foundMyMessage = true;
+                    }
+                });
+                receiver_socket.async_receive(boost::asio::buffer(buffer), read_handler);
+                return;
+            }
+
             std::string line(buffer, length);
             std::string suffix = "|" + std::to_string(id);
             
@@ -100,10 +128,7 @@ void run_client(int id, const std::string& host, const std::string& port_str, co
                     {
                         long long sent_ts = std::stoll(line.substr(0, delim));
                         long long rtt = current - sent_ts;
-                        {
-                            std::lock_guard<std::mutex> lock(latencies_mutex);
-                            latencies.push_back(rtt);
-                        }
+                        histogram.record(rtt);
                         foundMyMessage = true;
                     } 
                     catch (...) {}
@@ -125,20 +150,27 @@ void run_client(int id, const std::string& host, const std::string& port_str, co
         }
         errors++;
     }
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    latencies.merge(histogram);
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc < 5)
+    CommandLine args(argc, argv);
+    if (args.size() < 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <host> <port> <multicast_group> <clients>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <host> <port> <multicast_group> <clients> [--binary] [--histogram[=FILE]]" << std::endl;
+        std::cerr << "  --binary            binary wire frames instead of \"timestamp|id\" text" << std::endl;
+        std::cerr << "  --histogram[=FILE]  also print the full latency distribution (to FILE if given)" << std::endl;
         return 1;
     }
 
-    std::string host = argv[1];
-    std::string port = argv[2];
-    std::string multicast_group = argv[3];
-    int num_clients = std::stoi(argv[4]);
+    std::string host = args[0];
+    std::string port = args[1];
+    std::string multicast_group = args[2];
+    int num_clients = std::stoi(args[3]);
+    binary_mode = args.has("binary");
 
     std::cout << "Spawning " << num_clients << " clients connecting to " << host << ":" << port 
               << " and listening on " << multicast_group << "..." << std::endl;
@@ -168,13 +200,24 @@ int main(int argc, char* argv[])
     std::cout << "Finished " << num_clients << " clients in " << duration << "ms" << std::endl;
     std::cout << "Errors: " << errors << std::endl;
 
-    if (!latencies.empty())
+    if (latencies.count() > 0)
+    {
+        latencies.print_summary(std::cout);
+    }
+
+    // --histogram prints the full distribution, --histogram=FILE writes it to a file
+    if (args.has("histogram"))
     {
-        long long min_val = *std::min_element(latencies.begin(), latencies.end());
-        long long max_val = *std::max_element(latencies.begin(), latencies.end());
-        long long sum = std::accumulate(latencies.begin(), latencies.end(), 0LL);
-        double avg = static_cast<double>(sum) / latencies.size();
-        std::cout << "Latency (us) -> Min: " << min_val << ", Max: " << max_val << ", Avg: " << avg << std::endl;
+        std::string path = args.get("histogram");
+        if (path.empty())
+        {
+            latencies.print_distribution(std::cout);
+        }
+        else
+        {
+            std::ofstream file(path);
+            latencies.print_distribution(file);
+        }
     }
 
     return 0;
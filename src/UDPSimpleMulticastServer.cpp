@@ -11,6 +11,11 @@
 #include <boost/asio.hpp>
 #include <chrono>
 #include <algorithm>
+#include <array>
+#include "CommandLine.hpp"
+#include "UDPBatch.hpp"
+#include "ServerMetrics.hpp"
+#include "AsyncLog.hpp"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -21,7 +26,7 @@
 using boost::asio::ip::udp;
 using boost::asio::ip::make_address;
 
-void run_server(unsigned short port, const std::string& multicast_group)
+void run_server(unsigned short port, const std::string& multicast_group, size_t batch_size)
 {
     boost::asio::io_context io_context;
     udp::socket socket(io_context);
@@ -42,41 +47,76 @@ void run_server(unsigned short port, const std::string& multicast_group)
     udp::endpoint multicast_endpoint(make_address(multicast_group), port);
     std::cout << "Broadcasting to multicast group: " << multicast_endpoint << std::endl;
 
-    char data[1024];
+    std::array<udp::endpoint, 1> group{ multicast_endpoint };
+    ReceiveBatch received(batch_size);
+    SendBatch batch(batch_size);
+    std::vector<boost::asio::const_buffer> payloads;
+    payloads.reserve(received.size());
     try 
     {
         while (true) 
         {
-            udp::endpoint sender_endpoint;
-            size_t len = socket.receive_from(boost::asio::buffer(data), sender_endpoint);
+            size_t count = received.receive(socket);
 
-            if (len > 0)
+            payloads.clear();
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (received.data(i).size() > 0)
+                {
+                    metrics::received(received.data(i).size());
+                    payloads.push_back(received.data(i));
+                }
+            }
+
+            if (!payloads.empty())
             {
-                std::string msg(data, len);
                 auto start = std::chrono::high_resolution_clock::now();
-                socket.send_to(boost::asio::buffer(msg), multicast_endpoint);
+                size_t failures = 0;
+                if (payloads.size() == 1)
+                {
+                    socket.send_to(payloads[0], multicast_endpoint);
+                }
+                else
+                {
+                    // The whole receive batch goes to the group with one sendmmsg
+                    batch.send(socket, payloads.data(), payloads.size(), group);
+                    failures = batch.take_failures();
+                }
                 auto end = std::chrono::high_resolution_clock::now();
-                std::cout << "Broadcast took " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << "us" << std::endl;
+                metrics::fanout(end - start);
+
+                size_t bytes = 0;
+                for (const auto& payload : payloads)
+                {
+                    bytes += payload.size();
+                }
+                metrics::sent(bytes, payloads.size() - failures);
+                metrics::send_error(failures);
             }
         }
     } 
     catch (std::exception& e) 
     {
-        std::cerr << "Server error: " << e.what() << std::endl;
+        LOG_ERROR("Server error: {}", e.what());
     }
 }
 
 int main(int argc, char* argv[]) 
 {
-    if (argc < 3) 
+    CommandLine args(argc, argv);
+    if (args.size() < 2) 
     {
-        std::cerr << "Usage: " << argv[0] << " <port> <multicast_group>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <port> <multicast_group> [--recv-batch=N] [metrics options]" << std::endl;
+        std::cerr << "  --recv-batch=N  drain up to N datagrams per wakeup with recvmmsg (default 1)" << std::endl;
+        metrics::print_usage(std::cerr);
         return 1;
     }
 
-    unsigned short port = static_cast<unsigned short>(std::stoi(argv[1]));
-    std::string multicast_group = argv[2];
+    unsigned short port = static_cast<unsigned short>(std::stoi(args[0]));
+    std::string multicast_group = args[1];
+    size_t batch_size = static_cast<size_t>(std::max(1LL, args.getInt("recv-batch", 1)));
     std::cout << "Server listening on port " << port << "..." << std::endl;
+    metrics::start_reporting(args, "UDPSimpleMulticastServer");
 
     unsigned int thread_count = std::thread::hardware_concurrency();
     if (thread_count == 0) thread_count = 4;
@@ -84,7 +124,7 @@ int main(int argc, char* argv[])
     std::vector<std::thread> threads;
     for (unsigned int i = 0; i < thread_count; ++i)
     {
-        threads.emplace_back(run_server, port, multicast_group);
+        threads.emplace_back(run_server, port, multicast_group, batch_size);
     }
 
     for (auto& t : threads)
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// Optional binary framing, selected with --binary on the servers and load tests.
+// Every frame starts with a fixed 24-byte little-endian header:
+//
+//   offset  size  field
+//        0     4  length     whole frame in bytes, header included
+//        4     2  type       MessageType
+//        6     2  session    id from the Connect handshake with a --sessions server, else 0
+//        8     4  sender     load test client id
+//       12     4  sequence   per-sender message counter
+//       16     8  timestamp  microseconds since the epoch of high_resolution_clock
+//       24     -  payload    length - 24 bytes
+//
+// A PositionedBroadcast payload starts with the sender's x and y position as two
+// little-endian float32 (for area-of-interest servers), followed by any padding.
+//
+// Frames are self-delimiting, so a TCP stream or a tick-aggregated datagram is just
+// frames back to back. Receivers read fields in place through MessageView instead of
+// searching, copying and converting text.
+namespace wire
+{
+    enum class MessageType : uint16_t
+    {
+        Broadcast = 1,
+        PositionedBroadcast = 2,
+        // Delta-compressed world state and its acknowledgement, see DeltaSnapshots.hpp
+        Snapshot = 3,
+        SnapshotAck = 4,
+        // Reliability layer packet carrying messages and acknowledgements, see ReliableUdp.hpp
+        ReliablePacket = 5,
+        // Session handshake, see SessionTable.hpp. Connect asks for a session; Accept carries
+        // the assigned id in its session field, or 0 if there is none and the client has to
+        // connect (again).
+        Connect = 6,
+        Accept = 7,
+    };
+
+    constexpr size_t header_size = 24;
+    // Upper bound on a frame, so a corrupt length cannot make a reader buffer forever
+    constexpr size_t max_frame_size = 64 * 1024;
+
+    namespace detail
+    {
+        template <typename T>
+        inline T load(const char* data)
+        {
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                value |= static_cast<T>(static_cast<unsigned char>(data[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        template <typename T>
+        inline void store(char* data, T value)
+        {
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                data[i] = static_cast<char>(static_cast<unsigned char>(value >> (8 * i)));
+            }
+        }
+    }
+
+    // Read-only view of one complete frame. Does not own or copy the bytes.
+    class MessageView
+    {
+    public:
+        explicit MessageView(const char* frame)
+            : frame(frame)
+        {
+        }
+
+        uint32_t length() const { return detail::load<uint32_t>(frame); }
+        MessageType type() const { return static_cast<MessageType>(detail::load<uint16_t>(frame + 4)); }
+        uint16_t session() const { return detail::load<uint16_t>(frame + 6); }
+        uint32_t sender() const { return detail::load<uint32_t>(frame + 8); }
+        uint32_t sequence() const { return detail::load<uint32_t>(frame + 12); }
+        int64_t timestamp() const { return static_cast<int64_t>(detail::load<uint64_t>(frame + 16)); }
+
+        const char* payload() const { return frame + header_size; }
+        size_t payload_size() const { return length() - header_size; }
+
+        const char* data() const { return frame; }
+
+    private:
+        const char* frame;
+    };
+
+    constexpr size_t position_size = 8;
+
+    // Writes the x, y prefix of a PositionedBroadcast payload
+    inline void store_position(char* out, float x, float y)
+    {
+        detail::store<uint32_t>(out, std::bit_cast<uint32_t>(x));
+        detail::store<uint32_t>(out + 4, std::bit_cast<uint32_t>(y));
+    }
+
+    // False unless the frame is a PositionedBroadcast with a complete position
+    inline bool load_position(MessageView frame, float& x, float& y)
+    {
+        if (frame.type() != MessageType::PositionedBroadcast || frame.payload_size() < position_size)
+        {
+            return false;
+        }
+        x = std::bit_cast<float>(detail::load<uint32_t>(frame.payload()));
+        y = std::bit_cast<float>(detail::load<uint32_t>(frame.payload() + 4));
+        return true;
+    }
+
+    // Writes one frame to 'out', which must hold header_size + payload_size bytes.
+    // Returns the frame length.
+    inline size_t encode(char* out, MessageType type, uint32_t sender, uint32_t sequence, int64_t timestamp,
+                         const void* payload = nullptr, size_t payload_size = 0)
+    {
+        size_t length = header_size + payload_size;
+        detail::store<uint32_t>(out, static_cast<uint32_t>(length));
+        detail::store<uint16_t>(out + 4, static_cast<uint16_t>(type));
+        detail::store<uint16_t>(out + 6, 0);
+        detail::store<uint32_t>(out + 8, sender);
+        detail::store<uint32_t>(out + 12, sequence);
+        detail::store<uint64_t>(out + 16, static_cast<uint64_t>(timestamp));
+        if (payload_size > 0)
+        {
+            std::memcpy(out + header_size, payload, payload_size);
+        }
+        return length;
+    }
+
+    inline std::string encode(MessageType type, uint32_t sender, uint32_t sequence, int64_t timestamp,
+                              const void* payload = nullptr, size_t payload_size = 0)
+    {
+        std::string frame(header_size + payload_size, '\0');
+        encode(frame.data(), type, sender, sequence, timestamp, payload, payload_size);
+        return frame;
+    }
+
+    // Stamps the session id into an encoded frame
+    inline void set_session(char* frame, uint16_t session)
+    {
+        detail::store<uint16_t>(frame + 6, session);
+    }
+
+    // Length of the frame starting at 'data', or 0 if fewer than header_size bytes are
+    // available yet. Throws std::runtime_error on a length no valid frame can have.
+    inline size_t frame_length(const char* data, size_t available)
+    {
+        if (available < header_size)
+        {
+            return 0;
+        }
+        size_t length = detail::load<uint32_t>(data);
+        if (length < header_size || length > max_frame_size)
+        {
+            throw std::runtime_error("malformed frame length " + std::to_string(length));
+        }
+        return length;
+    }
+
+    // Calls on_frame(MessageView) for every complete frame in [data, data + size).
+    // Returns the number of bytes consumed; a trailing partial frame is left for the
+    // caller to keep until more bytes arrive.
+    template <typename OnFrame>
+    size_t for_each_frame(const char* data, size_t size, OnFrame&& on_frame)
+    {
+        size_t offset = 0;
+        while (true)
+        {
+            size_t length = frame_length(data + offset, size - offset);
+            if (length == 0 || length > size - offset)
+            {
+                return offset;
+            }
+            on_frame(MessageView(data + offset));
+            offset += length;
+        }
+    }
+
+    // Receive buffer for a framed byte stream. Read straight into space(), commit()
+    // the byte count, then drain() hands out every complete frame in place and keeps
+    // the partial tail. Grows only when a single frame does not fit.
+    class FrameBuffer
+    {
+    public:
+        explicit FrameBuffer(size_t initial_size = 16 * 1024)
+            : bytes(std::max(initial_size, header_size))
+        {
+        }
+
+        char* space() { return bytes.data() + filled; }
+        size_t space_size() const { return bytes.size() - filled; }
+
+        void commit(size_t count)
+        {
+            filled += count;
+        }
+
+        template <typename OnFrame>
+        void drain(OnFrame&& on_frame)
+        {
+            size_t consumed = for_each_frame(bytes.data(), filled, on_frame);
+            std::memmove(bytes.data(), bytes.data() + consumed, filled - consumed);
+            filled -= consumed;
+
+            if (filled == bytes.size())
+            {
+                // frame_length() has already rejected anything above max_frame_size
+                bytes.resize(std::min(bytes.size() * 2, max_frame_size));
+            }
+        }
+
+    private:
+        std::vector<char> bytes;
+        size_t filled = 0;
+    };
+}
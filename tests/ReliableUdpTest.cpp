@@ -0,0 +1,186 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ReliableUdp.hpp"
+
+// Drives two reliable::Connection objects against each other with a hand-written
+// schedule of lost packets. Exits non-zero if any check fails.
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    struct Peer
+    {
+        explicit Peer(uint32_t id, int max_attempts) : connection(id, max_attempts)
+        {
+        }
+
+        // Writes the next packet at 'now_us', or an empty string if there is nothing to send
+        std::string write(int64_t now_us)
+        {
+            std::string packet;
+            if (!connection.write_packet(packet, now_us))
+            {
+                packet.clear();
+            }
+            return packet;
+        }
+
+        void receive(const std::string& packet, int64_t now_us)
+        {
+            if (packet.empty())
+            {
+                return;
+            }
+            connection.receive(wire::MessageView(packet.data()), now_us, [this](reliable::Channel channel, const char* data, size_t size)
+            {
+                if (channel == reliable::Channel::Reliable)
+                {
+                    delivered.emplace_back(data, size);
+                }
+            });
+        }
+
+        void send(const std::string& message)
+        {
+            connection.send(reliable::Channel::Reliable, message.data(), message.size());
+        }
+
+        reliable::Connection connection;
+        std::vector<std::string> delivered;
+    };
+
+    // A message lost on every attempt must not hold back the ones sent after it
+    void abandoned_message_is_skipped()
+    {
+        constexpr int max_attempts = 2;
+        Peer sender(1, max_attempts);
+        Peer receiver(2, max_attempts);
+        int64_t now = 0;
+
+        sender.send("m0");
+        check(!sender.write(now).empty(), "first send of m0");
+
+        // m1 arrives while m0 is missing, so the receiver has to hold it back
+        sender.send("m1");
+        now += 1000;
+        receiver.receive(sender.write(now), now);
+        check(receiver.delivered.empty(), "m1 held back for m0");
+        sender.receive(receiver.write(now), now);
+
+        // Every resend of m0 is lost too, until it runs out of attempts
+        for (int round = 0; round < 4; ++round)
+        {
+            now += 2000000;
+            std::string packet = sender.write(now);
+            if (packet.empty())
+            {
+                break;
+            }
+            if (sender.connection.statistics().messages_abandoned > 0)
+            {
+                receiver.receive(packet, now);
+                break;
+            }
+        }
+        check(sender.connection.statistics().messages_abandoned == 1, "m0 abandoned after max_attempts");
+        check(receiver.delivered == std::vector<std::string>{"m1"}, "m1 delivered once m0 was abandoned");
+        check(receiver.connection.statistics().messages_skipped == 1, "m0 counted as skipped");
+
+        // The channel keeps working afterwards
+        for (int i = 2; i < 2000; ++i)
+        {
+            sender.send("m" + std::to_string(i));
+            now += 1000;
+            receiver.receive(sender.write(now), now);
+            sender.receive(receiver.write(now), now);
+        }
+        check(receiver.delivered.size() == 1999, "every later message delivered");
+        check(receiver.delivered.back() == "m1999", "later messages delivered in order");
+    }
+
+    // Messages that arrive while the receiver cannot hold any more out-of-order ones must
+    // not be acknowledged, so they are resent instead of lost
+    void held_overflow_is_resent()
+    {
+        constexpr int total = 1100; // more than the receiver holds back for one gap
+        Peer sender(1, 10);
+        Peer receiver(2, 10);
+        int64_t now = 0;
+
+        sender.send("m0");
+        check(!sender.write(now).empty(), "first send of m0");
+
+        // Well within the retransmission timeout, so each packet carries just the new message
+        for (int i = 1; i < total; ++i)
+        {
+            sender.send("m" + std::to_string(i));
+            now += 1;
+            receiver.receive(sender.write(now), now);
+            sender.receive(receiver.write(now), now);
+        }
+        check(receiver.delivered.empty(), "everything held back for m0");
+
+        // m0 and every message the receiver could not hold are resent
+        for (int round = 0; round < 10 && receiver.delivered.size() < total; ++round)
+        {
+            now += 200000;
+            for (std::string packet = sender.write(now); !packet.empty(); packet = sender.write(now))
+            {
+                receiver.receive(packet, now);
+            }
+            sender.receive(receiver.write(now), now);
+        }
+        check(receiver.delivered.size() == total, "no message lost to a full hold-back buffer");
+        bool in_order = receiver.delivered.size() == total;
+        for (int i = 0; in_order && i < total; ++i)
+        {
+            in_order = receiver.delivered[i] == "m" + std::to_string(i);
+        }
+        check(in_order, "held back messages delivered in order");
+        check(receiver.connection.statistics().messages_skipped == 0, "nothing skipped");
+        check(sender.connection.statistics().messages_abandoned == 0, "nothing abandoned");
+    }
+
+    // Without losses nothing is skipped or abandoned
+    void lossless_channel_delivers_everything()
+    {
+        Peer sender(1, 10);
+        Peer receiver(2, 10);
+        int64_t now = 0;
+        for (int i = 0; i < 100; ++i)
+        {
+            sender.send("m" + std::to_string(i));
+            now += 1000;
+            receiver.receive(sender.write(now), now);
+            sender.receive(receiver.write(now), now);
+        }
+        check(receiver.delivered.size() == 100, "all messages delivered");
+        check(receiver.connection.statistics().messages_skipped == 0, "nothing skipped");
+        check(sender.connection.statistics().messages_abandoned == 0, "nothing abandoned");
+    }
+}
+
+int main()
+{
+    abandoned_message_is_skipped();
+    held_overflow_is_resent();
+    lossless_channel_delivers_everything();
+    if (failures > 0)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "ReliableUdpTest passed" << std::endl;
+    return 0;
+}